@@ -1,11 +1,16 @@
 #pragma once
 
 #include "io.h"
+#include "mapped_image.h"
 #include "matrix.h"
 
 Image align(Image srcImage, bool isPostprocessing, std::string postprocessingType, double fraction, bool isMirror, 
             bool isInterp, bool isSubpixel, double subScale);  
 
+// Same, plates are read straight from the mapped file
+Image align(const MappedImage &srcImage, bool isPostprocessing, std::string postprocessingType, double fraction,
+            bool isMirror, bool isInterp, bool isSubpixel, double subScale);
+
 Image sobel_x(Image src_image);
 
 Image sobel_y(Image src_image);
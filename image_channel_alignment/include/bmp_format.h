@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+typedef unsigned int uint;
+
+// Layout of uncompressed BMP files, shared by io.cpp and mapped_image.cpp.
+// Header fields are little-endian regardless of the host.
+
+const uint BMP_FILE_HEADER_SIZE = 14;
+const uint BMP_INFO_HEADER_SIZE = 40;
+const uint BMP_HEADER_SIZE = BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE;
+
+inline uint32_t get_u32(const unsigned char *p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 |
+        uint32_t(p[3]) << 24;
+}
+
+inline uint16_t get_u16(const unsigned char *p)
+{
+    return uint16_t(p[0] | p[1] << 8);
+}
+
+inline void put_u32(unsigned char *p, uint32_t value)
+{
+    for (uint i = 0; i < 4; ++i)
+        p[i] = static_cast<unsigned char>(value >> (8 * i));
+}
+
+inline void put_u16(unsigned char *p, uint16_t value)
+{
+    p[0] = static_cast<unsigned char>(value);
+    p[1] = static_cast<unsigned char>(value >> 8);
+}
+
+// Rows are padded to a multiple of 4 bytes
+inline size_t bmp_row_size(uint width, uint bytes_per_pixel)
+{
+    return (size_t(width) * bytes_per_pixel + 3) / 4 * 4;
+}
+
+// Geometry of uncompressed 24 or 32-bit file
+struct BmpInfo
+{
+    uint32_t data_offset;
+    uint n_rows, n_cols;
+    // 3 or 4, pixels are stored as blue, green, red [, alpha]
+    uint bytes_per_pixel;
+    // rows are stored from bottom to top
+    bool bottom_up;
+    size_t row_bytes;
+};
+
+// Parse first BMP_HEADER_SIZE bytes of file.
+// Returns false if the file isn't uncompressed 24 or 32-bit BMP.
+bool parse_bmp_header(const unsigned char *header, BmpInfo *info);
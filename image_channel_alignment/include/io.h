@@ -7,5 +7,11 @@
 
 typedef Matrix<std::tuple<uint, uint, uint>> Image;
 
+// Uncompressed 24 and 32-bit files are read directly, other formats
+// through EasyBMP. Images are always saved as 24-bit files.
 Image load_image(const char*);
 void save_image(const Image&, const char*);
+
+// Same through EasyBMP per-pixel accessors, see io_benchmark.cpp
+Image load_image_easybmp(const char*);
+void save_image_easybmp(const Image&, const char*);
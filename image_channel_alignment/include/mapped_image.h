@@ -0,0 +1,75 @@
+#pragma once
+
+#include "io.h"
+#include "matrix.h"
+
+#include <memory>
+
+// Zero-copy image input.
+//
+// Uncompressed 24/32-bit BMP files and raw planar files are mapped into
+// memory with mmap, and their channels are exposed as matrices over the
+// mapping, so nothing is read into heap buffers. Pages are loaded by the
+// system on first access, only for rows which are actually used.
+//
+// Raw planar format (all numbers are little-endian uint32):
+//   "RAWP", rows, cols, channels (1 or 3),
+//   then channels planes of rows * cols bytes each, rows from top to bottom.
+//   Planes go in order red, green, blue; a single plane is gray.
+
+// One color channel of a mapped image, read-only.
+// Same interface as reading one element of Image tuples:
+// channel(i, j) is the value of pixel (i, j).
+class ChannelView
+{
+public:
+    // Pixel (i, j) is bytes.row(i)[j * step]
+    ChannelView(const Matrix<unsigned char> &bytes, uint step);
+
+    uint operator() (uint row, uint col) const
+    {
+        return bytes.row(row)[col * step];
+    }
+
+    // Same as Matrix::submatrix, shares memory
+    ChannelView submatrix(uint prow, uint pcol, uint rows, uint cols) const;
+
+    uint n_rows;
+    uint n_cols;
+
+private:
+    Matrix<unsigned char> bytes;
+    uint step;
+};
+
+class MappedImage
+{
+public:
+    // Channels are byte views over the mapping (see map_image()) which keep
+    // it alive, step is the distance between neighbour pixels in bytes
+    MappedImage(const Matrix<unsigned char> &red, const Matrix<unsigned char> &green,
+                const Matrix<unsigned char> &blue, uint step);
+
+    uint n_rows;
+    uint n_cols;
+
+    // Channel 0 is red, 1 is green, 2 is blue
+    ChannelView channel(uint index) const;
+
+    // Copy of the whole image
+    Image to_image() const;
+
+private:
+    ChannelView channels[3];
+};
+
+// Map file into memory. Returns nullptr if the file is neither uncompressed
+// 24/32-bit BMP nor raw planar, read such files with load_image().
+std::shared_ptr<MappedImage> map_image(const char *path);
+
+// Read raw planar file into res. Returns false if the file isn't raw
+// planar, read such files with load_image().
+bool load_planar_image(const char *path, Image *res);
+
+// Write image in raw planar format with three planes
+void save_planar_image(const Image &im, const char *path);
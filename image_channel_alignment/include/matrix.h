@@ -8,8 +8,19 @@
 #include <string>
 #include <type_traits>
 
+#include "allocator.h"
+
 typedef unsigned int uint;
 
+// Layout of matrix rows in memory.
+//
+// Packed: rows go back to back, stride equals the number of columns.
+// Aligned: stride is rounded up so that every row starts on a cache line
+// boundary (MatrixAllocator::CACHE_LINE bytes). Padding elements at the end
+// of rows are never visited. Use it for images processed row by row
+// with SIMD loads.
+enum class MatrixLayout { Packed, Aligned };
+
 template<typename ValueT>
 class Matrix
 {
@@ -19,8 +30,26 @@ public:
     // Number of cols
     const uint n_cols;
 
-    // Construct matrix with row_count of rows and col_count of columns
-    Matrix(uint row_count=0, uint col_count=0);
+    // Construct matrix with row_count of rows and col_count of columns.
+    // Memory is taken from allocator, by default it is the shared pool
+    // (see allocator.h), so temporaries of the same size are recycled.
+    Matrix(uint row_count=0, uint col_count=0,
+           MatrixAllocator *allocator=MatrixAllocator::get_default());
+
+    // Same, but with explicit layout of rows (see MatrixLayout).
+    //
+    // Example:
+    // Matrix<float> gray(480, 640, MatrixLayout::Aligned);
+    Matrix(uint row_count, uint col_count, MatrixLayout layout,
+           MatrixAllocator *allocator=MatrixAllocator::get_default());
+
+    // Matrix over memory it doesn't allocate, e.g. a file mapped with
+    // map_image() (see mapped_image.h). first_row shares ownership of that
+    // memory, row i starts row_step * i elements after it. The step may
+    // be negative for data stored bottom to top. The memory may be
+    // read-only: non-const access always makes a copy first.
+    Matrix(std::shared_ptr<ValueT> first_row, uint row_count, uint col_count,
+           int row_step);
 
     // Construct and initialize matrix which consists of one row.
     //
@@ -35,18 +64,32 @@ public:
     //                            {0.5, 0.6, 0.7, 0.8} };
     Matrix(std::initializer_list<std::initializer_list<ValueT>>);
 
-    // Shallow copy. Be careful, this function just copies the pointer
-    // to data and doesn't allocate any memory for data!
+    // Copy on write. This function just copies the pointer to data,
+    // the data itself is copied by the first non-const access
+    // (operator() or row()) to a matrix which shares it with others.
+    // So copies (and submatrices) never change each other, but do read
+    // through a const reference if you don't want to pay for a copy.
+    //
+    // Example:
+    // Matrix<int> a = {1, 2, 3};
+    // Matrix<int> b = a; // no allocation
+    // b(0, 0) = 7;       // b gets its own data, a is still 1 2 3
     Matrix(const Matrix&);
-    // Deep copy. Allocates memory and copies all values
+    // Deep copy. Allocates memory and copies all values.
+    // The copy has the same layout of rows as the source.
     Matrix<ValueT> deep_copy() const;
 
-    // Assignment operator
+    // Assignment operator, shares data the same way as copy constructor
     const Matrix<ValueT> &operator = (const Matrix<ValueT> &);
 
     // Move copy constructor. Needed when copy temporary object.
     // It is from c++ 11 standard.
     Matrix(Matrix&&);
+    // Move assignment. Takes data of the donor, which becomes empty.
+    // Pass images you don't need anymore with std::move to filters
+    // taking Image by value, then they don't copy on write:
+    // img = gray_world(std::move(img));
+    const Matrix<ValueT> &operator = (Matrix<ValueT> &&);
 
     // Desctructor, yeah.
     ~Matrix();
@@ -58,11 +101,21 @@ public:
     // Matrix<int> a = {9, 8, 7};
     // int i = a(0, 2); // i = 7;
     const ValueT &operator() (uint row, uint col) const;
-    // Non-const for assignment
+    // Non-const for assignment, makes own copy of shared data first
     // a(0, 1) = 3;
     // cout << a; // 9 3 7
     ValueT &operator() (uint row, uint col);
 
+    // Raw access to rows for inner loops, no bounds checking.
+    // row(i)[j] is the same element as (*this)(i, j); row(i + 1) starts
+    // row_stride() elements after row(i) (negative only for external data
+    // stored bottom to top). For a matrix with Aligned layout (and its
+    // submatrices starting at column 0) row(i) is cache line aligned.
+    ValueT *row(uint i);
+    const ValueT *row(uint i) const;
+    int row_stride() const;
+    MatrixLayout layout() const;
+
     // Matrix convolution.
     //
     // You give this function a unary operator. Operator _must_
@@ -119,7 +172,7 @@ public:
 private:
     // Stride - number of elements between two rows (needed for efficient
     // submatrix function without memory copy)
-    const uint stride;
+    const int stride;
     // First row and col, useful for taking submatrices. By default is (0, 0).
     const uint pin_row, pin_col;
     // shared_ptr still has no support of c-style arrays and
@@ -128,6 +181,23 @@ private:
     // so, for now we use shared_ptr just for counting links,
     // and work with raw pointer through get().
     std::shared_ptr<ValueT> _data;
+    // Where the data came from. Copies made by deep_copy() use it too.
+    MatrixAllocator *_allocator;
+
+    // Layout the storage was allocated with, submatrices share it.
+    MatrixLayout _layout;
+    // Data isn't ours (external memory constructor), it may be read-only,
+    // so non-const access always makes a copy first.
+    bool _external;
+
+    // Stride of a row of col_count elements in Aligned layout.
+    static uint aligned_stride(uint col_count);
+
+    // Position of element (row, col) relative to _data.
+    ptrdiff_t offset(uint row, uint col) const;
+
+    // Copy data if it is shared with another matrix or external.
+    void detach();
 
     // Const cast for writing public const fields.
     template<typename T> inline T& make_rw(const T& val) const;
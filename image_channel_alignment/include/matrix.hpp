@@ -7,30 +7,72 @@ T& Matrix<ValueT>::make_rw(const T& val) const
 }
 
 template<typename ValueT>
-Matrix<ValueT>::Matrix(uint row_count, uint col_count):
+uint Matrix<ValueT>::aligned_stride(uint col_count)
+{
+    // smallest number of elements which fill a whole number of cache lines
+    size_t a = MatrixAllocator::CACHE_LINE, b = sizeof(ValueT);
+    while (b) {
+        size_t t = a % b;
+        a = b;
+        b = t;
+    }
+    uint step = MatrixAllocator::CACHE_LINE / a;
+    return (col_count + step - 1) / step * step;
+}
+
+template<typename ValueT>
+Matrix<ValueT>::Matrix(uint row_count, uint col_count, MatrixAllocator *allocator):
+    Matrix(row_count, col_count, MatrixLayout::Packed, allocator)
+{
+}
+
+template<typename ValueT>
+Matrix<ValueT>::Matrix(uint row_count, uint col_count, MatrixLayout layout,
+                       MatrixAllocator *allocator):
     n_rows{row_count},
     n_cols{col_count},
-    stride{n_cols},
+    stride{static_cast<int>(layout == MatrixLayout::Aligned ? aligned_stride(col_count) : col_count)},
     pin_row{0},
     pin_col{0},
-    _data{}
+    _data{},
+    _allocator{allocator},
+    _layout{layout},
+    _external{false}
 {
-    auto size = n_cols * n_rows;
+    auto size = static_cast<size_t>(stride) * n_rows;
     if (size)
-        _data.reset(new ValueT[size], std::default_delete<ValueT[]>());
+        _data = make_storage<ValueT>(size, _allocator);
+}
+
+template<typename ValueT>
+Matrix<ValueT>::Matrix(std::shared_ptr<ValueT> first_row, uint row_count, uint col_count,
+                       int row_step):
+    n_rows{row_count},
+    n_cols{col_count},
+    stride{row_step},
+    pin_row{0},
+    pin_col{0},
+    _data{std::move(first_row)},
+    _allocator{MatrixAllocator::get_default()},
+    _layout{MatrixLayout::Packed},
+    _external{true}
+{
 }
 
 template<typename ValueT>
 Matrix<ValueT>::Matrix(std::initializer_list<ValueT> lst):
     n_rows{1},
     n_cols(lst.size()), // FIXME: narrowing.
-    stride{n_cols},
+    stride{static_cast<int>(n_cols)},
     pin_row{0},
     pin_col{0},
-    _data{}
+    _data{},
+    _allocator{MatrixAllocator::get_default()},
+    _layout{MatrixLayout::Packed},
+    _external{false}
 {
     if (n_cols) {
-        _data.reset(new ValueT[n_cols], std::default_delete<ValueT[]>());
+        _data = make_storage<ValueT>(n_cols, _allocator);
         std::copy(lst.begin(), lst.end(), _data.get());
     }
 }
@@ -38,10 +80,9 @@ Matrix<ValueT>::Matrix(std::initializer_list<ValueT> lst):
 template<typename ValueT>
 Matrix<ValueT> Matrix<ValueT>::deep_copy() const
 {
-    Matrix<ValueT> tmp(n_rows, n_cols);
+    Matrix<ValueT> tmp(n_rows, n_cols, _layout, _allocator);
     for (uint i = 0; i < n_rows; ++i)
-        for (uint j = 0; j < n_cols; ++j)
-            tmp(i, j) = (*this)(i, j);
+        std::copy(row(i), row(i) + n_cols, tmp.row(i));
     return tmp;
 }
 
@@ -54,16 +95,52 @@ const Matrix<ValueT> &Matrix<ValueT>::operator = (const Matrix<ValueT> &m)
     make_rw(pin_row) = m.pin_row;
     make_rw(pin_col) = m.pin_col;
     _data = m._data;
+    _allocator = m._allocator;
+    _layout = m._layout;
+    _external = m._external;
+    return *this;
+}
+
+template<typename ValueT>
+const Matrix<ValueT> &Matrix<ValueT>::operator = (Matrix<ValueT> &&m)
+{
+    if (this == &m)
+        return *this;
+    make_rw(n_rows) = m.n_rows;
+    make_rw(n_cols) = m.n_cols;
+    make_rw(stride) = m.stride;
+    make_rw(pin_row) = m.pin_row;
+    make_rw(pin_col) = m.pin_col;
+    _data = std::move(m._data);
+    _allocator = m._allocator;
+    _layout = m._layout;
+    _external = m._external;
+    // resetting state of donor object.
+    make_rw(m.n_rows) = 0;
+    make_rw(m.n_cols) = 0;
+    make_rw(m.stride) = 0;
+    make_rw(m.pin_row) = 0;
+    make_rw(m.pin_col) = 0;
     return *this;
 }
+
+template<typename ValueT>
+void Matrix<ValueT>::detach()
+{
+    if (_external or _data.use_count() > 1)
+        *this = deep_copy();
+}
 template<typename ValueT>
 Matrix<ValueT>::Matrix(std::initializer_list<std::initializer_list<ValueT>> lsts):
     n_rows(lsts.size()), // FIXME: narrowing.
     n_cols{0},
-    stride{n_cols},
+    stride{static_cast<int>(n_cols)},
     pin_row{0},
     pin_col{0},
-    _data{}
+    _data{},
+    _allocator{MatrixAllocator::get_default()},
+    _layout{MatrixLayout::Packed},
+    _external{false}
 {
     // check if no action is needed.
     if (n_rows == 0)
@@ -89,7 +166,7 @@ Matrix<ValueT>::Matrix(std::initializer_list<std::initializer_list<ValueT>> lsts
         return;
 
     // allocating matrix memory.
-    _data.reset(new ValueT[n_cols * n_rows], std::default_delete<ValueT[]>());
+    _data = make_storage<ValueT>(n_cols * n_rows, _allocator);
 
     // copying matrix data.
     {
@@ -110,7 +187,10 @@ Matrix<ValueT>::Matrix(const Matrix &src):
     stride{src.stride},
     pin_row{src.pin_row},
     pin_col{src.pin_col},
-    _data{src._data}
+    _data{src._data},
+    _allocator{src._allocator},
+    _layout{src._layout},
+    _external{src._external}
 {
 }
 
@@ -121,7 +201,10 @@ Matrix<ValueT>::Matrix(Matrix &&src):
     stride{src.stride},
     pin_row{src.pin_row},
     pin_col{src.pin_col},
-    _data{src._data}
+    _data{std::move(src._data)},
+    _allocator{src._allocator},
+    _layout{src._layout},
+    _external{src._external}
 {
     // resetting state of donor object.
     make_rw(src.n_rows) = 0;
@@ -129,7 +212,6 @@ Matrix<ValueT>::Matrix(Matrix &&src):
     make_rw(src.stride) = 0;
     make_rw(src.pin_row) = 0;
     make_rw(src.pin_col) = 0;
-    src._data.reset();
 }
 
 
@@ -138,9 +220,8 @@ ValueT &Matrix<ValueT>::operator()(uint row, uint col)
 {
     if (row >= n_rows or col >= n_cols)
         throw std::string("Out of bounds");
-    row += pin_row;
-    col += pin_col;
-    return _data.get()[row * stride + col];
+    detach();
+    return _data.get()[offset(row, col)];
 }
 
 template<typename ValueT>
@@ -148,9 +229,38 @@ const ValueT &Matrix<ValueT>::operator()(uint row, uint col) const
 {
     if (row >= n_rows or col >= n_cols)
         throw std::string("Out of bounds");
-    row += pin_row;
-    col += pin_col;
-    return _data.get()[row * stride + col];
+    return _data.get()[offset(row, col)];
+}
+
+template<typename ValueT>
+ValueT *Matrix<ValueT>::row(uint i)
+{
+    detach();
+    return _data.get() + offset(i, 0);
+}
+
+template<typename ValueT>
+const ValueT *Matrix<ValueT>::row(uint i) const
+{
+    return _data.get() + offset(i, 0);
+}
+
+template<typename ValueT>
+ptrdiff_t Matrix<ValueT>::offset(uint row, uint col) const
+{
+    return static_cast<ptrdiff_t>(row + pin_row) * stride + (col + pin_col);
+}
+
+template<typename ValueT>
+int Matrix<ValueT>::row_stride() const
+{
+    return stride;
+}
+
+template<typename ValueT>
+MatrixLayout Matrix<ValueT>::layout() const
+{
+    return _layout;
 }
 
 template<typename ValueT>
@@ -6,6 +6,9 @@
 #include <cstring>
 #include <vector>
 #include <array>
+#include <utility>
+#include <climits>
+#include <cstdint>
 
 using std::string;
 using std::cout;
@@ -15,7 +18,7 @@ using std::endl;
 #define GREEN 1
 #define BLUE 2
 
-Image mirror(Image srcImage, int radius)
+Image mirror(const Image &srcImage, int radius)
 {
     Image resImage(srcImage.n_rows + 2 * radius, srcImage.n_cols + 2 * radius);
 
@@ -63,11 +66,41 @@ Image mirror(Image srcImage, int radius)
     return resImage;
 }
 
-Image align(Image srcImage, bool isPostprocessing, std::string postprocessingType, double fraction, bool isMirror,
-            bool isInterp, bool isSubpixel, double subScale)
+// Один канал Image с тем же интерфейсом, что у ChannelView (см. mapped_image.h)
+template<int Channel>
+class ImageChannel
 {
-    // srcImage уже загружено
-    uint width = srcImage.n_cols, height = srcImage.n_rows / 3;
+public:
+    explicit ImageChannel(const Image &img):
+        n_rows{img.n_rows},
+        n_cols{img.n_cols},
+        image{img}
+    {}
+
+    uint operator() (uint row, uint col) const
+    {
+        return std::get<Channel>(image(row, col));
+    }
+
+    ImageChannel submatrix(uint prow, uint pcol, uint rows, uint cols) const
+    {
+        return ImageChannel(image.submatrix(prow, pcol, rows, cols));
+    }
+
+    uint n_rows;
+    uint n_cols;
+
+private:
+    const Image image;
+};
+
+// Совмещение по трем пластинам одинакового размера; от пластины нужен только
+// ее канал, так что это могут быть и каналы Image, и отображенный в память файл
+template<typename BlueT, typename GreenT, typename RedT>
+Image align_channels(const BlueT &blueFull, const GreenT &greenFull, const RedT &redFull,
+                     bool isPostprocessing, std::string postprocessingType, double fraction, bool isMirror)
+{
+    uint width = greenFull.n_cols, height = greenFull.n_rows;
 
     // это максимальный сдвиг; возьмем его как 5% от высоты и 5% от ширины
     int shift_h = height * 5 / 100, shift_w = width * 5 / 100;
@@ -76,9 +109,10 @@ Image align(Image srcImage, bool isPostprocessing, std::string postprocessingTyp
     // сразу отступаем на 10% от границ для улучшения метрики
     uint ind_h = height * 10 / 100, ind_w = width * 10 / 100; // отступы по высоте и ширине
     uint height_wi = height - 2 * ind_h, width_wi = width - 2 * ind_w; // высота и ширина с отступами
-    Image blueImage = srcImage.submatrix(ind_h, ind_w, height_wi, width_wi), // конструктор копирования
-          greenImage = srcImage.submatrix(height + ind_h, ind_w, height_wi, width_wi),
-          redImage = srcImage.submatrix(2 * height + ind_h, ind_w, height_wi, width_wi);
+    // подматрицы не копируют данные пластин
+    const BlueT blueImage = blueFull.submatrix(ind_h, ind_w, height_wi, width_wi);
+    const GreenT greenImage = greenFull.submatrix(ind_h, ind_w, height_wi, width_wi);
+    const RedT redImage = redFull.submatrix(ind_h, ind_w, height_wi, width_wi);
 
     // среднеквадратичное отклонение
 
@@ -93,8 +127,8 @@ Image align(Image srcImage, bool isPostprocessing, std::string postprocessingTyp
             // тут считаем сумму для перекрывающейся области
             for (uint i = std::max(0, shift_i); i < height_wi + std::min(0, shift_i); i++) {
                 for (uint j = std::max(0, shift_j); j < width_wi + std::min(0, shift_j); j++) { // i и j - для blueImage
-                    long long int tmp = static_cast<int>(std::get<GREEN>(greenImage(i, j))) -
-                                        static_cast<int>(std::get<RED>(redImage(i - shift_i, j - shift_j)));
+                    long long int tmp = static_cast<int>(greenImage(i, j)) -
+                                        static_cast<int>(redImage(i - shift_i, j - shift_j));
                     sum_pix += static_cast<unsigned long long>(tmp * tmp);
                 }
             }
@@ -121,8 +155,8 @@ Image align(Image srcImage, bool isPostprocessing, std::string postprocessingTyp
             // тут считаем сумму для перекрывающейся области
             for (uint i = std::max(0, shift_i); i < height_wi + std::min(0, shift_i); i++) {
                 for (uint j = std::max(0, shift_j); j < width_wi + std::min(0, shift_j); j++) { // i и j - для blueImage
-                    long long int tmp = static_cast<int>(std::get<GREEN>(greenImage(i, j))) -
-                                        static_cast<int>(std::get<BLUE>(blueImage(i - shift_i, j - shift_j)));
+                    long long int tmp = static_cast<int>(greenImage(i, j)) -
+                                        static_cast<int>(blueImage(i - shift_i, j - shift_j));
                     sum_pix += static_cast<unsigned long long>(tmp * tmp);
                 }
             }
@@ -140,11 +174,6 @@ Image align(Image srcImage, bool isPostprocessing, std::string postprocessingTyp
 
     // теперь лепим все воедино
 
-    // возвращаем отдельным цветам края
-    blueImage = srcImage.submatrix(0, 0, height, width);
-    greenImage = srcImage.submatrix(height, 0, height, width);
-    redImage = srcImage.submatrix(2 * height, 0, height, width);
-
     // изображение-результат; остальные изображеня двигаем относительно него
     Image resImage(height + std::min(std::min(0, shift_imin_rg), shift_imin_bg) - std::max(std::max(0, shift_imin_rg), shift_imin_bg),
                    width + std::min(std::min(0, shift_jmin_rg), shift_jmin_bg) - std::max(std::max(0, shift_jmin_rg), shift_jmin_bg));
@@ -155,18 +184,18 @@ Image align(Image srcImage, bool isPostprocessing, std::string postprocessingTyp
 
     for (uint i = 0; i < resImage.n_rows; i++) {
         for (uint j = 0; j < resImage.n_cols; j++) {
-            resImage(i, j) = std::make_tuple(std::get<RED>(redImage(i + shift_bi - std::min(0, shift_imin_rg) - std::max(0, shift_imin_rg),
-                                                                    j + shift_bj - std::min(0, shift_jmin_rg) - std::max(0, shift_jmin_rg))),
-                                             std::get<GREEN>(greenImage(i + shift_bi, j + shift_bj)),
-                                             std::get<BLUE>(blueImage(i + shift_bi - std::min(0, shift_imin_bg) - std::max(0, shift_imin_bg),
-                                                                        j + shift_bj - std::min(0, shift_jmin_bg) - std::max(0, shift_jmin_bg))));
+            resImage(i, j) = std::make_tuple(redFull(i + shift_bi - std::min(0, shift_imin_rg) - std::max(0, shift_imin_rg),
+                                                     j + shift_bj - std::min(0, shift_jmin_rg) - std::max(0, shift_jmin_rg)),
+                                             greenFull(i + shift_bi, j + shift_bj),
+                                             blueFull(i + shift_bi - std::min(0, shift_imin_bg) - std::max(0, shift_imin_bg),
+                                                      j + shift_bj - std::min(0, shift_jmin_bg) - std::max(0, shift_jmin_bg)));
         }
     }
 
     if (isPostprocessing) {
 
         if (postprocessingType == "--gray-world") {
-            resImage = gray_world(resImage);
+            resImage = gray_world(std::move(resImage));
         }
         if (postprocessingType == "--unsharp") {
             if (isMirror) {
@@ -180,25 +209,33 @@ Image align(Image srcImage, bool isPostprocessing, std::string postprocessingTyp
             }
         }
         if (postprocessingType == "--autocontrast") {
-            resImage = autocontrast(resImage, fraction);
+            resImage = autocontrast(std::move(resImage), fraction);
         }
     }
 
     return resImage;
 }
 
-Image sobel_x(Image src_image) {
-    Matrix<double> kernel = {{-1, 0, 1},
-                             {-2, 0, 2},
-                             {-1, 0, 1}};
-    return custom(src_image, kernel);
+Image align(Image srcImage, bool isPostprocessing, std::string postprocessingType, double fraction, bool isMirror,
+            bool isInterp, bool isSubpixel, double subScale)
+{
+    // srcImage уже загружено, пластины идут сверху вниз: синяя, зеленая, красная
+    uint width = srcImage.n_cols, height = srcImage.n_rows / 3;
+    return align_channels(ImageChannel<BLUE>(srcImage.submatrix(0, 0, height, width)),
+                          ImageChannel<GREEN>(srcImage.submatrix(height, 0, height, width)),
+                          ImageChannel<RED>(srcImage.submatrix(2 * height, 0, height, width)),
+                          isPostprocessing, postprocessingType, fraction, isMirror);
 }
 
-Image sobel_y(Image src_image) {
-    Matrix<double> kernel = {{ 1,  2,  1},
-                             { 0,  0,  0},
-                             {-1, -2, -1}};
-    return custom(src_image, kernel);
+Image align(const MappedImage &srcImage, bool isPostprocessing, std::string postprocessingType, double fraction,
+            bool isMirror, bool isInterp, bool isSubpixel, double subScale)
+{
+    // каналы читаются прямо из отображенного файла, без копии в куче
+    uint width = srcImage.n_cols, height = srcImage.n_rows / 3;
+    return align_channels(srcImage.channel(BLUE).submatrix(0, 0, height, width),
+                          srcImage.channel(GREEN).submatrix(height, 0, height, width),
+                          srcImage.channel(RED).submatrix(2 * height, 0, height, width),
+                          isPostprocessing, postprocessingType, fraction, isMirror);
 }
 
 Image gray_world(Image srcImage) {
@@ -247,50 +284,285 @@ Image resize(Image src_image, double scale) {
     return src_image;
 }
 
+// ноль ли вес; сравнение через <, > - чтобы не сравнивать double на равенство
+constexpr bool is_zero(double weight)
+{
+    return not (weight < 0) and not (weight > 0);
+}
+
+// сумма по ядру Size x Size для окрестности m; элемент ядра номер Tap
+// разворачивается рекурсией шаблонов, так что цикла по ядру нет вовсе,
+// а для ядер с constexpr весами нулевые веса выбрасываются при компиляции;
+// SumT - тип сумматора: double или int для фиксированной точки
+template<uint Size, uint Tap = 0>
+struct KernelTaps
+{
+    template<typename Weights, typename SumT>
+    static void add(const Image &m, const Weights &weights, SumT *sum)
+    {
+        const auto weight = weights.at(Tap / Size, Tap % Size);
+        if (not is_zero(weight)) {
+            uint red, green, blue;
+            std::tie(red, green, blue) = m.row(Tap / Size)[Tap % Size];
+            sum[RED] += static_cast<SumT>(red) * weight;
+            sum[GREEN] += static_cast<SumT>(green) * weight;
+            sum[BLUE] += static_cast<SumT>(blue) * weight;
+        }
+        KernelTaps<Size, Tap + 1>::add(m, weights, sum);
+    }
+};
+
+template<uint Size>
+struct KernelTaps<Size, Size * Size>
+{
+    template<typename Weights, typename SumT>
+    static void add(const Image &, const Weights &, SumT *)
+    {}
+};
+
+// обрезаем сумму до 0..255
+std::tuple<uint, uint, uint> clamp_pixel(const double *sum)
+{
+    uint channel[3];
+    for (uint c = 0; c < 3; c++) {
+        double value = sum[c];
+        if (value < 0) { value = 0; }
+        if (value > 255) { value = 255; }
+        channel[c] = static_cast<uint>(value);
+    }
+    return std::make_tuple(channel[RED], channel[GREEN], channel[BLUE]);
+}
+
+// свёртка с ядром фиксированного размера Size x Size;
+// Weights отдаёт веса через at(i, j); состояние хранится в самом операторе,
+// поэтому фильтры можно запускать одновременно из нескольких потоков
+template<uint Size, typename Weights>
+class ForKernel
+{
+public:
+    static const uint radius = Size / 2;
+
+    explicit ForKernel(const Weights &kernel_weights): weights(kernel_weights) {}
+
+    std::tuple<uint, uint, uint> operator () (const Image &m) const
+    {
+        double sum[3] = {0, 0, 0};
+        KernelTaps<Size>::add(m, weights, sum);
+        return clamp_pixel(sum);
+    }
+
+private:
+    Weights weights;
+};
+
+// свёртка в фиксированной точке: веса - целые числа weight * scale,
+// сумма копится в int, а не в double, и делится на scale в конце
+template<uint Size>
+struct FixedWeights
+{
+    int weight[Size][Size];
+    int scale;
+    // деление на scale заменяем умножением: floor(x / scale) == (x * magic) >> 40
+    // при 0 <= x < 256 * scale и scale < 2^16
+    uint64_t magic;
+
+    int at(uint i, uint j) const { return weight[i][j]; }
+};
+
+template<uint Size>
+class ForFixedKernel
+{
+public:
+    static const uint radius = Size / 2;
+
+    explicit ForFixedKernel(const FixedWeights<Size> &kernel_weights): weights(kernel_weights) {}
+
+    std::tuple<uint, uint, uint> operator () (const Image &m) const
+    {
+        int sum[3] = {0, 0, 0};
+        KernelTaps<Size>::add(m, weights, sum);
+
+        uint channel[3];
+        for (uint c = 0; c < 3; c++) {
+            if (sum[c] <= 0) {
+                channel[c] = 0;
+            } else if (sum[c] >= 256 * weights.scale) {
+                channel[c] = 255;
+            } else {
+                channel[c] = (static_cast<uint64_t>(sum[c]) * weights.magic) >> 40;
+            }
+        }
+        return std::make_tuple(channel[RED], channel[GREEN], channel[BLUE]);
+    }
+
+private:
+    FixedWeights<Size> weights;
+};
+
+// насколько (в уровнях яркости 0..255) сумма в фиксированной точке может
+// отличаться от точной суммы; если оценка больше, считаем в double
+const double FIXED_POINT_TOLERANCE = 1.0 / 16;
+// среди знаменателей до MAX_EXACT_SCALE ищем тот, с которым веса целые
+const int MAX_EXACT_SCALE = 1024;
+// иначе округляем веса, умноженные на ROUNDED_SCALE
+const int ROUNDED_SCALE = 1 << 15;
+
+// все ли веса ядра становятся целыми после умножения на scale
+template<uint Size, typename Weights>
+bool is_integral(const Weights &weights, int scale)
+{
+    for (uint i = 0; i < Size; i++) {
+        for (uint j = 0; j < Size; j++) {
+            double scaled = weights.at(i, j) * scale;
+            if (std::fabs(scaled - std::round(scaled)) > 1e-9)
+                return false;
+        }
+    }
+    return true;
+}
+
+// квантование ядра: берём наименьший scale, с которым веса целые
+// (у Собеля это 1, у unsharp - 6), тогда сумма считается точно;
+// если такого нет, округляем веса с масштабом ROUNDED_SCALE, и ошибка
+// суммы не больше 255 * sum|w - q / scale|, где q - округлённый вес;
+// возвращает false, если ошибка больше FIXED_POINT_TOLERANCE
+// или сумма может не поместиться в int
+template<uint Size, typename Weights>
+bool quantize(const Weights &weights, FixedWeights<Size> *fixed)
+{
+    int scale = 1;
+    while (scale <= MAX_EXACT_SCALE and not is_integral<Size>(weights, scale))
+        scale++;
+    if (scale > MAX_EXACT_SCALE)
+        scale = ROUNDED_SCALE;
+
+    double error = 0, abs_sum = 0;
+    for (uint i = 0; i < Size; i++) {
+        for (uint j = 0; j < Size; j++) {
+            double scaled = weights.at(i, j) * scale;
+            if (std::fabs(scaled) > INT_MAX / 255)
+                return false;
+            fixed->weight[i][j] = static_cast<int>(std::lround(scaled));
+            error += std::fabs(scaled - fixed->weight[i][j]);
+            abs_sum += std::abs(fixed->weight[i][j]);
+        }
+    }
+    if (255 * abs_sum > INT_MAX or 255 * error / scale > FIXED_POINT_TOLERANCE)
+        return false;
+
+    fixed->scale = scale;
+    fixed->magic = ((static_cast<uint64_t>(1) << 40) + scale - 1) / scale;
+    return true;
+}
+
+// свёртка изображения с ядром Size x Size: в фиксированной точке, если
+// ядро квантуется без заметной ошибки, иначе - в double
+template<uint Size, typename Weights>
+Image convolve_with(const Image &srcImage, const Weights &weights)
+{
+    FixedWeights<Size> fixed;
+    if (quantize<Size>(weights, &fixed))
+        return srcImage.unary_map(ForFixedKernel<Size>(fixed));
+    return srcImage.unary_map(ForKernel<Size, Weights>(weights));
+}
+
+// веса, известные только во время выполнения, но для ядра известного размера
+template<uint Size>
+struct RuntimeWeights
+{
+    double weight[Size][Size];
+
+    double at(uint i, uint j) const { return weight[i][j]; }
+};
+
+// ядра, известные при компиляции
+struct SobelXKernel
+{
+    static const uint size = 3;
+    static constexpr double weight[3][3] = {{-1, 0, 1},
+                                            {-2, 0, 2},
+                                            {-1, 0, 1}};
+    static constexpr double at(uint i, uint j) { return weight[i][j]; }
+};
+constexpr double SobelXKernel::weight[3][3];
+
+struct SobelYKernel
+{
+    static const uint size = 3;
+    static constexpr double weight[3][3] = {{ 1,  2,  1},
+                                            { 0,  0,  0},
+                                            {-1, -2, -1}};
+    static constexpr double at(uint i, uint j) { return weight[i][j]; }
+};
+constexpr double SobelYKernel::weight[3][3];
+
+struct UnsharpKernel
+{
+    static const uint size = 3;
+    static constexpr double weight[3][3] = {{-1 / 6.0, -2 / 3.0, -1 / 6.0},
+                                            { -2 / 3.0, 13 / 3.0, -2 / 3.0},
+                                            {-1 / 6.0, -2 / 3.0, -1 / 6.0}};
+    static constexpr double at(uint i, uint j) { return weight[i][j]; }
+};
+constexpr double UnsharpKernel::weight[3][3];
+
+template<typename Kernel>
+Image convolve(const Image &srcImage)
+{
+    return convolve_with<Kernel::size>(srcImage, Kernel());
+}
+
+template<uint Size>
+Image convolve(const Image &srcImage, const Matrix<double> &kernel)
+{
+    RuntimeWeights<Size> weights;
+    for (uint i = 0; i < Size; i++) {
+        for (uint j = 0; j < Size; j++) {
+            weights.weight[i][j] = kernel(i, j);
+        }
+    }
+    return convolve_with<Size>(srcImage, weights);
+}
+
+// свёртка с ядром произвольного размера, когда подходящей специализации нет
 class ForCustom
 {
 public:
+    explicit ForCustom(const Matrix<double> &kernel):
+        radius{kernel.n_rows / 2},
+        weight{kernel}
+    {}
+
     std::tuple<uint, uint, uint> operator () (const Image &m) const
     {
         uint size = 2 * radius + 1;
         uint red, green, blue;
-        double sum_red = 0, sum_green = 0, sum_blue = 0;
+        double sum[3] = {0, 0, 0};
         for (uint i = 0; i < size; i++) {
             for (uint j = 0; j < size; j++) {
                 std::tie(red, green, blue) = m(i, j);
-                sum_red += static_cast<double>(red) * weight(i, j);
-                sum_green += static_cast<double>(green) * weight(i, j);
-                sum_blue += static_cast<double>(blue) * weight(i, j);
+                sum[RED] += static_cast<double>(red) * weight(i, j);
+                sum[GREEN] += static_cast<double>(green) * weight(i, j);
+                sum[BLUE] += static_cast<double>(blue) * weight(i, j);
             }
         }
-        if (sum_red < 0) { sum_red = 0; }
-        if (sum_red > 255) { sum_red = 255; }
-
-        if (sum_green < 0) { sum_green = 0; }
-        if (sum_green > 255) { sum_green = 255; }
-
-        if (sum_blue < 0) { sum_blue = 0; }
-        if (sum_blue > 255) { sum_blue = 255; }
-
-        return std::make_tuple(static_cast<uint>(sum_red), static_cast<uint>(sum_green), static_cast<uint>(sum_blue));
+        return clamp_pixel(sum);
     }
 
-    static uint radius;
-    static Matrix<double> weight;
+    const uint radius;
+    const Matrix<double> weight;
 };
 
-uint ForCustom::radius;
-Matrix<double> ForCustom::weight;
-
-Image unsharp(Image srcImage) {
-    Matrix<double> kernel = {{-1 / 6.0, -2 / 3.0, -1 / 6.0},
-                             { -2 / 3.0, 13 / 3.0, -2 / 3.0},
-                             {-1 / 6.0, -2 / 3.0, -1 / 6.0}};
+Image sobel_x(Image src_image) {
+    return convolve<SobelXKernel>(src_image);
+}
 
-    ForCustom::radius = 1;
-    srcImage = custom(srcImage, kernel);
+Image sobel_y(Image src_image) {
+    return convolve<SobelYKernel>(src_image);
+}
 
-    return srcImage;
+Image unsharp(Image srcImage) {
+    return convolve<UnsharpKernel>(srcImage);
 }
 
 Image custom(Image srcImage, Matrix<double> kernel) {
@@ -299,11 +571,20 @@ Image custom(Image srcImage, Matrix<double> kernel) {
     // and then implement other filtrations using this function.
     // sobel_x and sobel_y are given as an example.
 
-    ForCustom::weight = kernel;
-
-    srcImage = srcImage.unary_map(ForCustom());
-
-    return srcImage;
+    if (kernel.n_rows != kernel.n_cols or kernel.n_rows % 2 == 0)
+        throw string("kernel must be square and have odd size");
+
+    // ядра распространённых размеров считаем развёрнутыми специализациями
+    switch (kernel.n_rows) {
+    case 3:
+        return convolve<3>(srcImage, kernel);
+    case 5:
+        return convolve<5>(srcImage, kernel);
+    case 7:
+        return convolve<7>(srcImage, kernel);
+    default:
+        return srcImage.unary_map(ForCustom(kernel));
+    }
 }
 
 Image autocontrast(Image srcImage, double fraction) {
@@ -375,7 +656,8 @@ Image median(Image srcImage, int radius) {
 
     srcImage = mirror(srcImage, radius);
 
-    Image resImage = srcImage.deep_copy();
+    // края отрезаются в конце, поэтому копировать srcImage незачем
+    Image resImage(srcImage.n_rows, srcImage.n_cols);
 
     for (uint i = 0 + radius; i < srcImage.n_rows - radius; i++) {
         for (uint j = 0 + radius; j < srcImage.n_cols - radius; j++) {
@@ -416,7 +698,8 @@ Image median_linear(Image srcImage, int radius) {
 
     srcImage = mirror(srcImage, radius);
     // линейная медиана
-    Image resImage = srcImage.deep_copy();
+    // края отрезаются в конце, поэтому копировать srcImage незачем
+    Image resImage(srcImage.n_rows, srcImage.n_cols);
 
     uint histo_red[256], histo_green[256], histo_blue[256]; // гистограммы
     std::memset(histo_red, 0, sizeof(histo_red)); // обнуляем массив гистограмм
@@ -623,7 +906,8 @@ uint get_median(std::array<uint, 256> histo, int med) {
 Image median_const(Image srcImage, int radius) {
     srcImage = mirror(srcImage, radius);
 
-    Image resImage = srcImage.deep_copy();
+    // края отрезаются в конце, поэтому копировать srcImage незачем
+    Image resImage(srcImage.n_rows, srcImage.n_cols);
 
     int med = (2 * radius + 1); // индекс медианы в массиве
     med *= med;
@@ -1,13 +1,180 @@
 #include "io.h"
+#include "bmp_format.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
 using std::string;
+using std::vector;
+using std::unique_ptr;
 
 using std::tuple;
 using std::make_tuple;
 using std::tie;
 
+// Uncompressed 24 and 32-bit files are decoded and encoded here directly:
+// pixel rows are moved between the file and the image in bands, with one
+// fread/fwrite per band, instead of going through EasyBMP, which keeps its
+// own per-column copy of the image and is accessed pixel by pixel.
+// Everything else (palettes, 16 bits, compression) falls back to EasyBMP.
+
+// Pixels per meter written to the header, same as EasyBMP (96 dpi)
+static const uint32_t PELS_PER_METER = 3780;
+// Approximate size of one band of rows
+static const size_t BAND_BYTES = 256 * 1024;
+
+typedef unique_ptr<FILE, int (*)(FILE*)> File;
+
+static File open_file(const char *path, const char *mode)
+{
+    return File(fopen(path, mode), fclose);
+}
+
+static uint rows_per_band(size_t row_bytes)
+{
+    size_t rows = row_bytes ? BAND_BYTES / row_bytes : 0;
+    return rows ? uint(rows) : 1;
+}
+
+bool parse_bmp_header(const unsigned char *header, BmpInfo *bmp)
+{
+    const unsigned char *info = header + BMP_FILE_HEADER_SIZE;
+    int32_t width = static_cast<int32_t>(get_u32(info + 4));
+    int32_t height = static_cast<int32_t>(get_u32(info + 8));
+    uint bits_per_pixel = get_u16(info + 14);
+
+    if (header[0] != 'B' || header[1] != 'M' ||
+        get_u32(info) < BMP_INFO_HEADER_SIZE || get_u16(info + 12) != 1 ||
+        (bits_per_pixel != 24 && bits_per_pixel != 32) ||
+        get_u32(info + 16) != 0 || width <= 0 || height == 0 || height == INT32_MIN)
+        return false;
+
+    // positive height means that rows are stored from bottom to top
+    bmp->data_offset = get_u32(header + 10);
+    bmp->bottom_up = height > 0;
+    bmp->n_rows = bmp->bottom_up ? uint(height) : uint(-height);
+    bmp->n_cols = uint(width);
+    bmp->bytes_per_pixel = bits_per_pixel / 8;
+    bmp->row_bytes = bmp_row_size(bmp->n_cols, bmp->bytes_per_pixel);
+    return true;
+}
+
+// Reads uncompressed 24 or 32-bit file into res.
+// Returns false if the file has any other format.
+static bool fast_load(const char *path, Image &res)
+{
+    File file = open_file(path, "rb");
+    if (!file)
+        throw string("Error reading file ") + string(path);
+
+    unsigned char header[BMP_HEADER_SIZE];
+    BmpInfo bmp;
+    if (fread(header, sizeof(header), 1, file.get()) != 1 ||
+        !parse_bmp_header(header, &bmp))
+        return false;
+
+    if (fseek(file.get(), bmp.data_offset, SEEK_SET))
+        throw string("Error reading file ") + string(path);
+
+    uint n_rows = bmp.n_rows, n_cols = bmp.n_cols;
+    uint bytes_per_pixel = bmp.bytes_per_pixel;
+    size_t row_bytes = bmp.row_bytes;
+    uint band = rows_per_band(row_bytes);
+    vector<unsigned char> buffer(band * row_bytes);
+
+    res = Image(n_rows, n_cols);
+    for (uint first = 0; first < n_rows; first += band) {
+        uint count = std::min(band, n_rows - first);
+        if (fread(buffer.data(), row_bytes, count, file.get()) != count)
+            throw string("Error reading file ") + string(path);
+
+        for (uint k = 0; k < count; ++k) {
+            uint i = bmp.bottom_up ? n_rows - 1 - (first + k) : first + k;
+            const unsigned char *src = buffer.data() + k * row_bytes;
+            tuple<uint, uint, uint> *dst = res.row(i);
+            // pixels are stored as blue, green, red [, alpha]
+            for (uint j = 0; j < n_cols; ++j, src += bytes_per_pixel)
+                dst[j] = make_tuple(src[2], src[1], src[0]);
+        }
+    }
+
+    return true;
+}
+
+// Writes 24-bit file with the same headers as EasyBMP does.
+// Not for empty images, EasyBMP writes them as 1x1
+static void fast_save(const Image &im, const char *path)
+{
+    const uint bytes_per_pixel = 3;
+    size_t row_bytes = bmp_row_size(im.n_cols, bytes_per_pixel);
+    uint32_t data_size = uint32_t(row_bytes * im.n_rows);
+
+    unsigned char header[BMP_HEADER_SIZE] = {};
+    header[0] = 'B';
+    header[1] = 'M';
+    put_u32(header + 2, BMP_HEADER_SIZE + data_size);
+    put_u32(header + 10, BMP_HEADER_SIZE);
+
+    unsigned char *info = header + BMP_FILE_HEADER_SIZE;
+    put_u32(info, BMP_INFO_HEADER_SIZE);
+    put_u32(info + 4, im.n_cols);
+    put_u32(info + 8, im.n_rows);
+    put_u16(info + 12, 1);
+    put_u16(info + 14, 8 * bytes_per_pixel);
+    put_u32(info + 20, data_size);
+    put_u32(info + 24, PELS_PER_METER);
+    put_u32(info + 28, PELS_PER_METER);
+
+    File file = open_file(path, "wb");
+    if (!file || fwrite(header, sizeof(header), 1, file.get()) != 1)
+        throw string("Error writing file ") + string(path);
+
+    uint band = rows_per_band(row_bytes);
+    // padding bytes are never touched and stay zero
+    vector<unsigned char> buffer(band * row_bytes);
+
+    uint r, g, b;
+    for (uint first = 0; first < im.n_rows; first += band) {
+        uint count = std::min(band, im.n_rows - first);
+        for (uint k = 0; k < count; ++k) {
+            // bottom row goes first
+            const tuple<uint, uint, uint> *src = im.row(im.n_rows - 1 - (first + k));
+            unsigned char *dst = buffer.data() + k * row_bytes;
+            for (uint j = 0; j < im.n_cols; ++j, dst += bytes_per_pixel) {
+                tie(r, g, b) = src[j];
+                dst[0] = static_cast<unsigned char>(b);
+                dst[1] = static_cast<unsigned char>(g);
+                dst[2] = static_cast<unsigned char>(r);
+            }
+        }
+        if (fwrite(buffer.data(), row_bytes, count, file.get()) != count)
+            throw string("Error writing file ") + string(path);
+    }
+
+    if (fclose(file.release()))
+        throw string("Error writing file ") + string(path);
+}
+
 Image load_image(const char *path)
+{
+    Image res;
+    if (fast_load(path, res))
+        return res;
+    return load_image_easybmp(path);
+}
+
+void save_image(const Image &im, const char *path)
+{
+    if (im.n_rows == 0 || im.n_cols == 0)
+        save_image_easybmp(im, path);
+    else
+        fast_save(im, path);
+}
+
+Image load_image_easybmp(const char *path)
 {
     BMP in;
 
@@ -17,28 +184,28 @@ Image load_image(const char *path)
     Image res(in.TellHeight(), in.TellWidth());
 
     for (uint i = 0; i < res.n_rows; ++i) {
-        for (uint j = 0; j < res.n_cols; ++j) {
-            RGBApixel *p = in(j, i);
-            res(i, j) = make_tuple(p->Red, p->Green, p->Blue);
-        }
+        const RGBApixel *src = in.Row(i);
+        tuple<uint, uint, uint> *dst = res.row(i);
+        for (uint j = 0; j < res.n_cols; ++j)
+            dst[j] = make_tuple(src[j].Red, src[j].Green, src[j].Blue);
     }
 
     return res;
 }
 
-void save_image(const Image &im, const char *path)
+void save_image_easybmp(const Image &im, const char *path)
 {
     BMP out;
     out.SetSize(im.n_cols, im.n_rows);
 
     uint r, g, b;
-    RGBApixel p;
-    p.Alpha = 255;
     for (uint i = 0; i < im.n_rows; ++i) {
+        const tuple<uint, uint, uint> *src = im.row(i);
+        RGBApixel *dst = out.Row(i);
         for (uint j = 0; j < im.n_cols; ++j) {
-            tie(r, g, b) = im(i, j);
-            p.Red = r; p.Green = g; p.Blue = b;
-            out.SetPixel(j, i, p);
+            tie(r, g, b) = src[j];
+            dst[j].Red = r; dst[j].Green = g; dst[j].Blue = b;
+            dst[j].Alpha = 255;
         }
     }
 
@@ -0,0 +1,65 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "io.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+// Speed of load_image/save_image compared to the EasyBMP path.
+// Usage: io_benchmark <in_image.bmp> <out_image.bmp> [repeats]
+
+typedef Image (*Loader)(const char*);
+typedef void (*Saver)(const Image&, const char*);
+
+// Megabytes of pixel data processed per second
+static double throughput(const Image &im, uint repeats, steady_clock::time_point start)
+{
+    double seconds = duration<double>(steady_clock::now() - start).count();
+    double megabytes = 3.0 * im.n_rows * im.n_cols * repeats / (1 << 20);
+    return megabytes / seconds;
+}
+
+static void measure(const char *name, Loader load, Saver save,
+    const char *in_path, const char *out_path, uint repeats)
+{
+    Image im = load(in_path);
+
+    auto start = steady_clock::now();
+    for (uint i = 0; i < repeats; ++i)
+        im = load(in_path);
+    double load_speed = throughput(im, repeats, start);
+
+    start = steady_clock::now();
+    for (uint i = 0; i < repeats; ++i)
+        save(im, out_path);
+    double save_speed = throughput(im, repeats, start);
+
+    cout << name << ": load " << load_speed << " MB/s, save "
+        << save_speed << " MB/s" << endl;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " <in_image.bmp> <out_image.bmp> [repeats]" << endl;
+        return 1;
+    }
+    uint repeats = argc > 3 ? uint(atoi(argv[3])) : 20;
+    if (repeats == 0)
+        repeats = 1;
+
+    try {
+        measure("direct ", load_image, save_image, argv[1], argv[2], repeats);
+        measure("EasyBMP", load_image_easybmp, save_image_easybmp, argv[1], argv[2], repeats);
+    } catch (const string &s) {
+        cerr << "Error: " << s << endl;
+        return 1;
+    }
+}
@@ -4,6 +4,8 @@
 #include <fstream>
 #include <initializer_list>
 #include <limits>
+#include <utility>
+#include <memory>
 
 using std::string;
 using std::stringstream;
@@ -76,6 +78,9 @@ R"(where PARAMS are from list:
     kernel_string = '1,2,3;4,5,6;7,8,9' defines kernel of size 3
 
 [<param>=default_val] means that parameter is optional.
+
+--planar-output as the last argument saves output image in raw planar
+format, such input images are recognized by their contents.
 )";
     cout << "Usage: " << argv0 << " <input_image_path> <output_image_path> "
          << "PARAMS" << endl;
@@ -165,11 +170,24 @@ int main(int argc, char **argv)
             return 0;
         }
 
-        check_argc(argc, 4);
-        Image src_image = load_image(argv[1]), dst_image;
+        // output format option goes last, the rest don't see it
+        bool planar_output = argc > 4 and string(argv[argc - 1]) == "--planar-output";
+        if (planar_output)
+            --argc;
 
+        check_argc(argc, 4);
         string action(argv[3]);
 
+        // Uncompressed files are mapped into memory for --align, it reads
+        // the plates straight from the mapping; other actions read BMP
+        // files with load_image()
+        std::shared_ptr<MappedImage> mapped;
+        if (action == "--align")
+            mapped = map_image(argv[1]);
+        Image src_image, dst_image;
+        if (!mapped and !load_planar_image(argv[1], &src_image))
+            src_image = load_image(argv[1]);
+
         if (action == "--sobel-x") {
             check_argc(argc, 4, 4);
             dst_image = sobel_x(src_image);
@@ -181,7 +199,7 @@ int main(int argc, char **argv)
             dst_image = unsharp(src_image);
         } else if (action == "--gray-world") {
             check_argc(argc, 4, 4);
-            dst_image = gray_world(src_image);
+            dst_image = gray_world(std::move(src_image));
         } else if (action == "--resize") {
             check_argc(argc, 5, 5);
             double scale = read_value<double>(argv[4]);
@@ -197,7 +215,7 @@ int main(int argc, char **argv)
                 fraction = read_value<double>(argv[4]);
                 check_number("fraction", fraction, 0.0, 0.4);
             }
-            dst_image = autocontrast(src_image, fraction);
+            dst_image = autocontrast(std::move(src_image), fraction);
         } else if (action == "--gaussian" || action == "--gaussian-separable") {
             check_argc(argc, 5, 6);
             double sigma = read_value<double>(argv[4]);
@@ -249,12 +267,20 @@ int main(int argc, char **argv)
                     &isInterp, &isSubpixel, &subScale);
             }
 
-            dst_image = align(src_image, isPostprocessing, postprocessingType, fraction, isMirror,
-                isInterp, isSubpixel, subScale);
+            if (mapped) {
+                dst_image = align(*mapped, isPostprocessing, postprocessingType, fraction, isMirror,
+                    isInterp, isSubpixel, subScale);
+            } else {
+                dst_image = align(src_image, isPostprocessing, postprocessingType, fraction, isMirror,
+                    isInterp, isSubpixel, subScale);
+            }
         } else {
             throw string("unknown action ") + action;
         }
-        save_image(dst_image, argv[2]);
+        if (planar_output)
+            save_planar_image(dst_image, argv[2]);
+        else
+            save_image(dst_image, argv[2]);
     } catch (const string &s) {
         cerr << "Error: " << s << endl;
         cerr << "For help type: " << endl << argv[0] << " --help" << endl;
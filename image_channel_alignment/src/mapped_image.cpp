@@ -0,0 +1,207 @@
+#include "mapped_image.h"
+#include "bmp_format.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+using std::shared_ptr;
+
+using std::tuple;
+using std::make_tuple;
+using std::tie;
+
+static const char RAW_MAGIC[4] = {'R', 'A', 'W', 'P'};
+static const uint RAW_HEADER_SIZE = 16;
+
+ChannelView::ChannelView(const Matrix<unsigned char> &pixel_bytes, uint pixel_step):
+    n_rows{pixel_bytes.n_rows},
+    n_cols{(pixel_bytes.n_cols + pixel_step - 1) / pixel_step},
+    bytes{pixel_bytes},
+    step{pixel_step}
+{}
+
+ChannelView ChannelView::submatrix(uint prow, uint pcol, uint rows, uint cols) const
+{
+    if (prow + rows > n_rows || pcol + cols > n_cols)
+        throw string("Out of bounds");
+    // last pixel of channel is the last byte of view
+    uint byte_cols = cols ? (cols - 1) * step + 1 : 0;
+    return ChannelView(bytes.submatrix(prow, pcol * step, rows, byte_cols), step);
+}
+
+MappedImage::MappedImage(const Matrix<unsigned char> &red, const Matrix<unsigned char> &green,
+                         const Matrix<unsigned char> &blue, uint step):
+    n_rows{red.n_rows},
+    n_cols{ChannelView(red, step).n_cols},
+    channels{ChannelView(red, step), ChannelView(green, step), ChannelView(blue, step)}
+{}
+
+ChannelView MappedImage::channel(uint index) const
+{
+    if (index >= 3)
+        throw string("Out of bounds");
+    return channels[index];
+}
+
+Image MappedImage::to_image() const
+{
+    Image res(n_rows, n_cols);
+    for (uint i = 0; i < n_rows; ++i) {
+        tuple<uint, uint, uint> *dst = res.row(i);
+        for (uint j = 0; j < n_cols; ++j)
+            dst[j] = make_tuple(channels[0](i, j), channels[1](i, j), channels[2](i, j));
+    }
+    return res;
+}
+
+// Whole file mapped read-only: views over it copy the data before
+// any write (see Matrix external memory constructor).
+// Returns nullptr for empty files.
+static shared_ptr<unsigned char> map_file(const char *path, size_t *size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        throw string("Error reading file ") + string(path);
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        throw string("Error reading file ") + string(path);
+    }
+    *size = size_t(st.st_size);
+    if (*size == 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    void *ptr = mmap(nullptr, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+    if (ptr == MAP_FAILED)
+        throw string("Error reading file ") + string(path);
+
+    size_t length = *size;
+    return shared_ptr<unsigned char>(static_cast<unsigned char*>(ptr),
+                                     [length](unsigned char *p) { munmap(p, length); });
+}
+
+// Byte matrix starting at offset of the mapping, sharing its ownership
+static Matrix<unsigned char> view(const shared_ptr<unsigned char> &mapping, ptrdiff_t offset,
+                                  uint rows, uint cols, int stride)
+{
+    shared_ptr<unsigned char> first_row(mapping, mapping.get() + offset);
+    return Matrix<unsigned char>(first_row, rows, cols, stride);
+}
+
+static shared_ptr<MappedImage> map_bmp(const char *path, const shared_ptr<unsigned char> &mapping,
+                                       size_t size)
+{
+    BmpInfo bmp;
+    if (size < BMP_HEADER_SIZE || !parse_bmp_header(mapping.get(), &bmp))
+        return nullptr;
+    if (bmp.data_offset + bmp.row_bytes * bmp.n_rows > size)
+        throw string("Error reading file ") + string(path);
+
+    // top row of the image and step to the next one
+    ptrdiff_t top = bmp.data_offset;
+    int stride = int(bmp.row_bytes);
+    if (bmp.bottom_up) {
+        top += ptrdiff_t(bmp.row_bytes) * (bmp.n_rows - 1);
+        stride = -stride;
+    }
+
+    // pixels are stored as blue, green, red [, alpha]
+    uint step = bmp.bytes_per_pixel, cols = (bmp.n_cols - 1) * step + 1;
+    return shared_ptr<MappedImage>(new MappedImage(
+        view(mapping, top + 2, bmp.n_rows, cols, stride),
+        view(mapping, top + 1, bmp.n_rows, cols, stride),
+        view(mapping, top, bmp.n_rows, cols, stride), step));
+}
+
+static shared_ptr<MappedImage> map_raw(const char *path, const shared_ptr<unsigned char> &mapping,
+                                       size_t size)
+{
+    const unsigned char *header = mapping.get();
+    if (size < RAW_HEADER_SIZE || memcmp(header, RAW_MAGIC, sizeof(RAW_MAGIC)))
+        return nullptr;
+
+    uint rows = get_u32(header + 4), cols = get_u32(header + 8);
+    uint planes = get_u32(header + 12);
+    size_t plane_size = size_t(rows) * cols;
+    if (rows == 0 || cols == 0 || (planes != 1 && planes != 3) ||
+        RAW_HEADER_SIZE + plane_size * planes > size)
+        throw string("Error reading file ") + string(path);
+
+    Matrix<unsigned char> red = view(mapping, RAW_HEADER_SIZE, rows, cols, int(cols));
+    if (planes == 1)
+        return shared_ptr<MappedImage>(new MappedImage(red, red, red, 1));
+    return shared_ptr<MappedImage>(new MappedImage(red,
+        view(mapping, RAW_HEADER_SIZE + plane_size, rows, cols, int(cols)),
+        view(mapping, RAW_HEADER_SIZE + 2 * plane_size, rows, cols, int(cols)), 1));
+}
+
+shared_ptr<MappedImage> map_image(const char *path)
+{
+    size_t size = 0;
+    shared_ptr<unsigned char> mapping = map_file(path, &size);
+    if (!mapping)
+        return nullptr;
+
+    shared_ptr<MappedImage> res = map_bmp(path, mapping, size);
+    if (!res)
+        res = map_raw(path, mapping, size);
+    return res;
+}
+
+bool load_planar_image(const char *path, Image *res)
+{
+    size_t size = 0;
+    shared_ptr<unsigned char> mapping = map_file(path, &size);
+    if (!mapping)
+        return false;
+    shared_ptr<MappedImage> mapped = map_raw(path, mapping, size);
+    if (!mapped)
+        return false;
+    *res = mapped->to_image();
+    return true;
+}
+
+void save_planar_image(const Image &im, const char *path)
+{
+    unsigned char header[RAW_HEADER_SIZE];
+    memcpy(header, RAW_MAGIC, sizeof(RAW_MAGIC));
+    put_u32(header + 4, im.n_rows);
+    put_u32(header + 8, im.n_cols);
+    put_u32(header + 12, 3);
+
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        throw string("Error writing file ") + string(path);
+    bool ok = fwrite(header, sizeof(header), 1, file) == 1;
+
+    // one plane at a time, row by row
+    vector<unsigned char> buffer(im.n_cols);
+    uint pixel[3];
+    for (uint plane = 0; plane < 3 && ok; ++plane) {
+        for (uint i = 0; i < im.n_rows && ok; ++i) {
+            const tuple<uint, uint, uint> *src = im.row(i);
+            for (uint j = 0; j < im.n_cols; ++j) {
+                tie(pixel[0], pixel[1], pixel[2]) = src[j];
+                buffer[j] = static_cast<unsigned char>(pixel[plane]);
+            }
+            ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+        }
+    }
+
+    if (fclose(file) || !ok)
+        throw string("Error writing file ") + string(path);
+}
@@ -30,7 +30,9 @@ class BMP
  int BitDepth;
  int Width;
  int Height;
- RGBApixel** Pixels;
+ // Width*Height pixels row by row from top to bottom,
+ // pixel (i,j) is Pixels[j*Width+i]
+ RGBApixel* Pixels;
  RGBApixel* Colors;
  int XPelsPerMeter;
  int YPelsPerMeter;
@@ -69,6 +71,11 @@ class BMP
  ~BMP();
  RGBApixel* operator()(int i,int j);
 
+ // Raw access to row j (0 is the top row): Width pixels one after
+ // another, rows follow each other without gaps. NULL if j is out of range.
+ RGBApixel* Row( int j );
+ const RGBApixel* Row( int j ) const;
+
  RGBApixel GetPixel( int i, int j ) const;
  bool SetPixel( int i, int j, RGBApixel NewPixel );
 
@@ -131,12 +131,12 @@ RGBApixel BMP::GetPixel( int i, int j ) const
        << "                 Truncating request to fit in the range [0,"
        << Width-1 << "] x [0," << Height-1 << "]." << endl;
  }	
- return Pixels[i][j];
+ return Pixels[j*Width+i];
 }
 
 bool BMP::SetPixel( int i, int j, RGBApixel NewPixel )
 {
- Pixels[i][j] = NewPixel;
+ Pixels[j*Width+i] = NewPixel;
  return true;
 }
 
@@ -225,8 +225,7 @@ BMP::BMP()
  Width = 1;
  Height = 1;
  BitDepth = 24;
- Pixels = new RGBApixel* [Width];
- Pixels[0] = new RGBApixel [Height];
+ Pixels = new RGBApixel [Width*Height];
  Colors = NULL;
  
  XPelsPerMeter = 0;
@@ -246,8 +245,7 @@ BMP::BMP( BMP& Input )
  Width = 1;
  Height = 1;
  BitDepth = 24;
- Pixels = new RGBApixel* [Width];
- Pixels[0] = new RGBApixel [Height];
+ Pixels = new RGBApixel [Width*Height];
  Colors = NULL; 
  XPelsPerMeter = 0;
  YPelsPerMeter = 0;
@@ -286,17 +284,14 @@ BMP::BMP( BMP& Input )
  {
   for( int i=0; i < Width ; i++ )
   {
-   Pixels[i][j] = *Input(i,j);
-//   Pixels[i][j] = Input.GetPixel(i,j); // *Input(i,j);
+   Pixels[j*Width+i] = *Input(i,j);
+//   Pixels[j*Width+i] = Input.GetPixel(i,j); // *Input(i,j);
   }
  }
 }
 
 BMP::~BMP()
 {
- int i;
- for(i=0;i<Width;i++)
- { delete [] Pixels[i]; }
  delete [] Pixels;
  if( Colors )
  { delete [] Colors; }
@@ -325,7 +320,21 @@ RGBApixel* BMP::operator()(int i, int j)
        << "                 Truncating request to fit in the range [0,"
        << Width-1 << "] x [0," << Height-1 << "]." << endl;
  }	
- return &(Pixels[i][j]);
+ return &(Pixels[j*Width+i]);
+}
+
+RGBApixel* BMP::Row( int j )
+{
+ if( j < 0 || j >= Height )
+ { return NULL; }
+ return Pixels + j*Width;
+}
+
+const RGBApixel* BMP::Row( int j ) const
+{
+ if( j < 0 || j >= Height )
+ { return NULL; }
+ return Pixels + j*Width;
 }
 
 // int BMP::TellBitDepth( void ) const
@@ -394,28 +403,20 @@ bool BMP::SetSize(int NewWidth , int NewHeight )
   return false;
  }
 
- int i,j; 
+ int i; 
 
- for(i=0;i<Width;i++)
- { delete [] Pixels[i]; }
  delete [] Pixels;
 
  Width = NewWidth;
  Height = NewHeight;
- Pixels = new RGBApixel* [ Width ]; 
+ Pixels = new RGBApixel [ Width*Height ]; 
  
- for(i=0; i<Width; i++)
- { Pixels[i] = new RGBApixel [ Height ]; }
- 
- for( i=0 ; i < Width ; i++)
+ for( i=0 ; i < Width*Height ; i++)
  {
-  for( j=0 ; j < Height ; j++ )
-  {
-   Pixels[i][j].Red = 255; 
-   Pixels[i][j].Green = 255; 
-   Pixels[i][j].Blue = 255; 
-   Pixels[i][j].Alpha = 0;    
-  }
+  Pixels[i].Red = 255; 
+  Pixels[i].Green = 255; 
+  Pixels[i].Blue = 255; 
+  Pixels[i].Alpha = 0;    
  }
 
  return true; 
@@ -637,9 +638,9 @@ bool BMP::WriteToFile( const char* FileName )
    {
     ebmpWORD TempWORD;
 	
-	ebmpWORD RedWORD = (ebmpWORD) ((Pixels[i][j]).Red / 8);
-	ebmpWORD GreenWORD = (ebmpWORD) ((Pixels[i][j]).Green / 4);
-	ebmpWORD BlueWORD = (ebmpWORD) ((Pixels[i][j]).Blue / 8);
+	ebmpWORD RedWORD = (ebmpWORD) ((Pixels[j*Width+i]).Red / 8);
+	ebmpWORD GreenWORD = (ebmpWORD) ((Pixels[j*Width+i]).Green / 4);
+	ebmpWORD BlueWORD = (ebmpWORD) ((Pixels[j*Width+i]).Blue / 8);
 	
     TempWORD = (RedWORD<<11) + (GreenWORD<<5) + BlueWORD;
 	if( IsBigEndian() )
@@ -1062,9 +1063,9 @@ bool BMP::ReadFromFile( const char* FileName )
     ebmpBYTE GreenBYTE = (ebmpBYTE) 8*(Green>>GreenShift);
     ebmpBYTE RedBYTE = (ebmpBYTE) 8*(Red>>RedShift);
 		
-	(Pixels[i][j]).Red = RedBYTE;
-	(Pixels[i][j]).Green = GreenBYTE;
-	(Pixels[i][j]).Blue = BlueBYTE;
+	(Pixels[j*Width+i]).Red = RedBYTE;
+	(Pixels[j*Width+i]).Green = GreenBYTE;
+	(Pixels[j*Width+i]).Blue = BlueBYTE;
 	
 	i++;
    }
@@ -1560,11 +1561,9 @@ bool CreateGrayscaleColorTable( BMP& InputImage )
 
 bool BMP::Read32bitRow( ebmpBYTE* Buffer, int BufferSize, int Row )
 { 
- int i;
  if( Width*4 > BufferSize )
  { return false; }
- for( i=0 ; i < Width ; i++ )
- { memcpy( (char*) &(Pixels[i][Row]), (char*) Buffer+4*i, 4 ); }
+ memcpy( (char*) (Pixels+Row*Width), (char*) Buffer, 4*Width );
  return true;
 }
 
@@ -1573,8 +1572,9 @@ bool BMP::Read24bitRow( ebmpBYTE* Buffer, int BufferSize, int Row )
  int i;
  if( Width*3 > BufferSize )
  { return false; }
+ RGBApixel* Line = Pixels+Row*Width;
  for( i=0 ; i < Width ; i++ )
- { memcpy( (char*) &(Pixels[i][Row]), Buffer+3*i, 3 ); }
+ { memcpy( (char*) (Line+i), Buffer+3*i, 3 ); }
  return true;
 }
 
@@ -1641,11 +1641,9 @@ bool BMP::Read1bitRow(  ebmpBYTE* Buffer, int BufferSize, int Row )
 
 bool BMP::Write32bitRow( ebmpBYTE* Buffer, int BufferSize, int Row )
 { 
- int i;
  if( Width*4 > BufferSize )
  { return false; }
- for( i=0 ; i < Width ; i++ )
- { memcpy( (char*) Buffer+4*i, (char*) &(Pixels[i][Row]), 4 ); }
+ memcpy( (char*) Buffer, (char*) (Pixels+Row*Width), 4*Width );
  return true;
 }
 
@@ -1654,8 +1652,9 @@ bool BMP::Write24bitRow( ebmpBYTE* Buffer, int BufferSize, int Row )
  int i;
  if( Width*3 > BufferSize )
  { return false; }
+ RGBApixel* Line = Pixels+Row*Width;
  for( i=0 ; i < Width ; i++ )
- { memcpy( (char*) Buffer+3*i,  (char*) &(Pixels[i][Row]), 3 ); }
+ { memcpy( (char*) Buffer+3*i,  (char*) (Line+i), 3 ); }
  return true;
 }
 
@@ -1665,7 +1664,7 @@ bool BMP::Write8bitRow(  ebmpBYTE* Buffer, int BufferSize, int Row )
  if( Width > BufferSize )
  { return false; }
  for( i=0 ; i < Width ; i++ )
- { Buffer[i] = FindClosestColor( Pixels[i][Row] ); }
+ { Buffer[i] = FindClosestColor( Pixels[Row*Width+i] ); }
  return true;
 }
 
@@ -1684,7 +1683,7 @@ bool BMP::Write4bitRow(  ebmpBYTE* Buffer, int BufferSize, int Row )
   int Index = 0;
   while( j < 2 && i < Width )
   {
-   Index += ( PositionWeights[j]* (int) FindClosestColor( Pixels[i][Row] ) ); 
+   Index += ( PositionWeights[j]* (int) FindClosestColor( Pixels[Row*Width+i] ) ); 
    i++; j++;   
   }
   Buffer[k] = (ebmpBYTE) Index;
@@ -1708,7 +1707,7 @@ bool BMP::Write1bitRow(  ebmpBYTE* Buffer, int BufferSize, int Row )
   int Index = 0;
   while( j < 8 && i < Width )
   {
-   Index += ( PositionWeights[j]* (int) FindClosestColor( Pixels[i][Row] ) ); 
+   Index += ( PositionWeights[j]* (int) FindClosestColor( Pixels[Row*Width+i] ) ); 
    i++; j++;   
   }
   Buffer[k] = (ebmpBYTE) Index;
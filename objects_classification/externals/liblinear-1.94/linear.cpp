@@ -4,6 +4,8 @@
 #include <string.h>
 #include <stdarg.h>
 #include <locale.h>
+#include <thread>
+#include <vector>
 #include "linear.h"
 #include "tron.h"
 typedef signed char schar;
@@ -30,6 +32,17 @@ static void print_string_stdout(const char *s)
 
 static void (*liblinear_print_string) (const char *) = &print_string_stdout;
 
+// Random numbers of the solvers. Every train_one() call (and the
+// Crammer-Singer solver) draws from its own generator seeded by train(),
+// so one-vs-rest sub-problems give the same models whether they are trained
+// one by one or on several threads.
+static thread_local unsigned int solver_seed = 1;
+
+static int solver_rand()
+{
+	return rand_r(&solver_seed);
+}
+
 #if 1
 static void info(const char *fmt,...)
 {
@@ -586,7 +599,7 @@ void Solver_MCSVM_CS::Solve(double *w)
 		double stopping = -INF;
 		for(i=0;i<active_size;i++)
 		{
-			int j = i+rand()%(active_size-i);
+			int j = i+solver_rand()%(active_size-i);
 			swap(index[i], index[j]);
 		}
 		for(s=0;s<active_size;s++)
@@ -745,6 +758,82 @@ void Solver_MCSVM_CS::Solve(double *w)
 	delete [] active_size_i;
 }
 
+// Rows of a problem for solve_l2r_l1l2_svc: sparse feature_node arrays
+// or dense float rows (see train_dense). Sums go over features in the same
+// order in both, so a dense problem gives the same solution as its sparse
+// copy, while its rows take 4 bytes per feature instead of 16.
+class sparse_rows
+{
+public:
+	sparse_rows(feature_node * const *x_): x(x_) {}
+
+	// init + xi^T xi
+	double sq_norm(int i, double init) const
+	{
+		double s = init;
+		for(const feature_node *xi = x[i]; xi->index != -1; xi++)
+			s += xi->value*xi->value;
+		return s;
+	}
+	double dot(int i, const double *w) const
+	{
+		double s = 0;
+		for(const feature_node *xi = x[i]; xi->index != -1; xi++)
+			s += w[xi->index-1]*xi->value;
+		return s;
+	}
+	// w += a*xi
+	void axpy(int i, double a, double *w) const
+	{
+		for(const feature_node *xi = x[i]; xi->index != -1; xi++)
+			w[xi->index-1] += a*xi->value;
+	}
+
+private:
+	feature_node * const *x;
+};
+
+class dense_rows
+{
+public:
+	// n features per row, bias (if >= 0) is feature n+1 of every row
+	dense_rows(const float * const *x_, int n_, double bias_): x(x_), n(n_), bias(bias_) {}
+
+	double sq_norm(int i, double init) const
+	{
+		const float *xi = x[i];
+		double s = init;
+		for(int j=0; j<n; j++)
+			s += (double)xi[j]*xi[j];
+		if(bias >= 0)
+			s += bias*bias;
+		return s;
+	}
+	double dot(int i, const double *w) const
+	{
+		const float *xi = x[i];
+		double s = 0;
+		for(int j=0; j<n; j++)
+			s += w[j]*xi[j];
+		if(bias >= 0)
+			s += w[n]*bias;
+		return s;
+	}
+	void axpy(int i, double a, double *w) const
+	{
+		const float *xi = x[i];
+		for(int j=0; j<n; j++)
+			w[j] += a*xi[j];
+		if(bias >= 0)
+			w[n] += a*bias;
+	}
+
+private:
+	const float * const *x;
+	int n;
+	double bias;
+};
+
 // A coordinate descent algorithm for 
 // L1-loss and L2-loss SVM dual problems
 //
@@ -775,9 +864,13 @@ void Solver_MCSVM_CS::Solve(double *w)
 #define GETI(i) (y[i]+1)
 // To support weights for instances, use GETI(i) (i)
 
+// l, n and y are taken from prob, features from rows.
+// alpha_io: NULL or l dual variables to start from (warm start),
+// replaced by the solution
+template <class Rows>
 static void solve_l2r_l1l2_svc(
-	const problem *prob, double *w, double eps,
-	double Cp, double Cn, int solver_type)
+	const problem *prob, const Rows &rows, double *w, double eps,
+	double Cp, double Cn, int solver_type, double *alpha_io)
 {
 	int l = prob->l;
 	int w_size = prob->n;
@@ -822,22 +915,17 @@ static void solve_l2r_l1l2_svc(
 	// Initial alpha can be set here. Note that
 	// 0 <= alpha[i] <= upper_bound[GETI(i)]
 	for(i=0; i<l; i++)
-		alpha[i] = 0;
+		if(alpha_io)
+			alpha[i] = min(max(alpha_io[i], 0.0), upper_bound[GETI(i)]);
+		else
+			alpha[i] = 0;
 
 	for(i=0; i<w_size; i++)
 		w[i] = 0;
 	for(i=0; i<l; i++)
 	{
-		QD[i] = diag[GETI(i)];
-
-		feature_node *xi = prob->x[i];
-		while (xi->index != -1)
-		{
-			double val = xi->value;
-			QD[i] += val*val;
-			w[xi->index-1] += y[i]*alpha[i]*val;
-			xi++;
-		}
+		QD[i] = rows.sq_norm(i, diag[GETI(i)]);
+		rows.axpy(i, y[i]*alpha[i], w);
 		index[i] = i;
 	}
 
@@ -848,22 +936,16 @@ static void solve_l2r_l1l2_svc(
 
 		for (i=0; i<active_size; i++)
 		{
-			int j = i+rand()%(active_size-i);
+			int j = i+solver_rand()%(active_size-i);
 			swap(index[i], index[j]);
 		}
 
 		for (s=0; s<active_size; s++)
 		{
 			i = index[s];
-			G = 0;
 			schar yi = y[i];
 
-			feature_node *xi = prob->x[i];
-			while(xi->index!= -1)
-			{
-				G += w[xi->index-1]*(xi->value);
-				xi++;
-			}
+			G = rows.dot(i, w);
 			G = G*yi-1;
 
 			C = upper_bound[GETI(i)];
@@ -905,12 +987,7 @@ static void solve_l2r_l1l2_svc(
 				double alpha_old = alpha[i];
 				alpha[i] = min(max(alpha[i] - G/QD[i], 0.0), C);
 				d = (alpha[i] - alpha_old)*yi;
-				xi = prob->x[i];
-				while (xi->index != -1)
-				{
-					w[xi->index-1] += d*xi->value;
-					xi++;
-				}
+				rows.axpy(i, d, w);
 			}
 		}
 
@@ -958,6 +1035,10 @@ static void solve_l2r_l1l2_svc(
 	info("Objective value = %lf\n",v/2);
 	info("nSV = %d\n",nSV);
 
+	if(alpha_io)
+		for(i=0; i<l; i++)
+			alpha_io[i] = alpha[i];
+
 	delete [] QD;
 	delete [] alpha;
 	delete [] y;
@@ -1056,7 +1137,7 @@ static void solve_l2r_l1l2_svr(
 
 		for(i=0; i<active_size; i++)
 		{
-			int j = i+rand()%(active_size-i);
+			int j = i+solver_rand()%(active_size-i);
 			swap(index[i], index[j]);
 		}
 
@@ -1276,7 +1357,7 @@ void solve_l2r_lr_dual(const problem *prob, double *w, double eps, double Cp, do
 	{
 		for (i=0; i<l; i++)
 		{
-			int j = i+rand()%(l-i);
+			int j = i+solver_rand()%(l-i);
 			swap(index[i], index[j]);
 		}
 		int newton_iter = 0;
@@ -1457,7 +1538,7 @@ static void solve_l1r_l2_svc(
 
 		for(j=0; j<active_size; j++)
 		{
-			int i = j+rand()%(active_size-j);
+			int i = j+solver_rand()%(active_size-j);
 			swap(index[i], index[j]);
 		}
 
@@ -1832,7 +1913,7 @@ static void solve_l1r_lr(
 
 			for(j=0; j<QP_active_size; j++)
 			{
-				int i = j+rand()%(QP_active_size-j);
+				int i = j+solver_rand()%(QP_active_size-j);
 				swap(index[i], index[j]);
 			}
 
@@ -2178,8 +2259,12 @@ static void group_classes(const problem *prob, int *nr_class_ret, int **label_re
 	free(data_label);
 }
 
-static void train_one(const problem *prob, const parameter *param, double *w, double Cp, double Cn)
+// dense_x: dense rows of prob (see train_dense) or NULL, only dual SVC solvers use them;
+// seed: seed of solver_rand() for this problem;
+// alpha: NULL or dual variables to start from and to keep, dual SVC solvers only
+static void train_one(const problem *prob, const float * const *dense_x, const parameter *param, double *w, double Cp, double Cn, unsigned int seed, double *alpha)
 {
+	solver_seed = seed;
 	double eps=param->eps;
 	int pos = 0;
 	int neg = 0;
@@ -2230,10 +2315,12 @@ static void train_one(const problem *prob, const parameter *param, double *w, do
 			break;
 		}
 		case L2R_L2LOSS_SVC_DUAL:
-			solve_l2r_l1l2_svc(prob, w, eps, Cp, Cn, L2R_L2LOSS_SVC_DUAL);
-			break;
 		case L2R_L1LOSS_SVC_DUAL:
-			solve_l2r_l1l2_svc(prob, w, eps, Cp, Cn, L2R_L1LOSS_SVC_DUAL);
+			if(dense_x)
+				solve_l2r_l1l2_svc(prob, dense_rows(dense_x, prob->bias>=0 ? prob->n-1 : prob->n, prob->bias),
+					w, eps, Cp, Cn, param->solver_type, alpha);
+			else
+				solve_l2r_l1l2_svc(prob, sparse_rows(prob->x), w, eps, Cp, Cn, param->solver_type, alpha);
 			break;
 		case L1R_L2LOSS_SVC:
 		{
@@ -2287,10 +2374,64 @@ static void train_one(const problem *prob, const parameter *param, double *w, do
 	}
 }
 
-//
-// Interface functions
-//
-model* train(const problem *prob, const parameter *param)
+// One-vs-rest sub-problems of train(), read-only for all threads
+struct one_vs_rest
+{
+	const problem *prob;		// rows grouped by class, y is not used
+	const float * const *dense_x;
+	const parameter *param;
+	int nr_class;
+	const int *start;
+	const int *count;
+	const double *weighted_C;
+	const unsigned int *seed;	// seed of every class
+	double *alpha;			// NULL or l dual variables of every class
+	double *w;			// weights of the model, nr_class per feature
+};
+
+// Trains classes first, first+step, ... of ovr, each on its own labels and weights
+static void train_one_vs_rest(const one_vs_rest *ovr, int first, int step)
+{
+	int l = ovr->prob->l;
+	int w_size = ovr->prob->n;
+	problem sub_prob = *ovr->prob;
+	sub_prob.y = Malloc(double,l);
+	double *w = Malloc(double, w_size);
+	for(int i=first;i<ovr->nr_class;i+=step)
+	{
+		int si = ovr->start[i];
+		int ei = si+ovr->count[i];
+
+		int k=0;
+		for(; k<si; k++)
+			sub_prob.y[k] = -1;
+		for(; k<ei; k++)
+			sub_prob.y[k] = +1;
+		for(; k<sub_prob.l; k++)
+			sub_prob.y[k] = -1;
+
+		train_one(&sub_prob, ovr->dense_x, ovr->param, w, ovr->weighted_C[i], ovr->param->C, ovr->seed[i],
+			ovr->alpha ? ovr->alpha+(size_t)i*l : NULL);
+
+		for(int j=0;j<w_size;j++)
+			ovr->w[j*ovr->nr_class+i] = w[j];
+	}
+	free(w);
+	free(sub_prob.y);
+}
+
+// Seed of a solver: from rand(), or from rand_r(seed) if seed isn't NULL
+static unsigned int next_seed(unsigned int *seed)
+{
+	return seed ? (unsigned int)rand_r(seed) : (unsigned int)rand();
+}
+
+// train() and train_dense(): dense_x are dense rows of prob or NULL.
+// seed: NULL or state of the seeds of solvers (see next_seed);
+// dual_sol: NULL or nr_class*l dual variables of the dual SVC solvers,
+// l per sub-problem in the order of prob, to start from and to keep
+static model* train_rows(const problem *prob, const float * const *dense_x, const parameter *param,
+	unsigned int *seed, double *dual_sol)
 {
 	int i,j;
 	int l = prob->l;
@@ -2312,7 +2453,7 @@ model* train(const problem *prob, const parameter *param)
 		model_->w = Malloc(double, w_size);
 		model_->nr_class = 2;
 		model_->label = NULL;
-		train_one(prob, param, &model_->w[0], 0, 0);
+		train_one(prob, dense_x, param, &model_->w[0], 0, 0, next_seed(seed), NULL);
 	}
 	else
 	{
@@ -2348,18 +2489,27 @@ model* train(const problem *prob, const parameter *param)
 		// constructing the subproblem
 		feature_node **x = Malloc(feature_node *,l);
 		for(i=0;i<l;i++)
-			x[i] = prob->x[perm[i]];
+			x[i] = dense_x ? NULL : prob->x[perm[i]];
 
 		int k;
 		problem sub_prob;
 		sub_prob.l = l;
 		sub_prob.n = n;
+		sub_prob.bias = prob->bias;
 		sub_prob.x = Malloc(feature_node *,sub_prob.l);
 		sub_prob.y = Malloc(double,sub_prob.l);
 
 		for(k=0; k<sub_prob.l; k++)
 			sub_prob.x[k] = x[k];
 
+		const float **sub_dense_x = NULL;
+		if(dense_x)
+		{
+			sub_dense_x = Malloc(const float *,l);
+			for(i=0;i<l;i++)
+				sub_dense_x[i] = dense_x[perm[i]];
+		}
+
 		// multi-class svm by Crammer and Singer
 		if(param->solver_type == MCSVM_CS)
 		{
@@ -2368,10 +2518,22 @@ model* train(const problem *prob, const parameter *param)
 				for(j=start[i];j<start[i]+count[i];j++)
 					sub_prob.y[j] = i;
 			Solver_MCSVM_CS Solver(&sub_prob, nr_class, weighted_C, param->eps);
+			solver_seed = next_seed(seed);
 			Solver.Solve(model_->w);
 		}
 		else
 		{
+			// dual variables in the order of sub_prob
+			int nr_sub = nr_class == 2 ? 1 : nr_class;
+			double *sub_alpha = NULL;
+			if(dual_sol)
+			{
+				sub_alpha = Malloc(double, (size_t)nr_sub*l);
+				for(k=0;k<nr_sub;k++)
+					for(i=0;i<l;i++)
+						sub_alpha[(size_t)k*l+i] = dual_sol[(size_t)k*l+perm[i]];
+			}
+
 			if(nr_class == 2)
 			{
 				model_->w=Malloc(double, w_size);
@@ -2383,33 +2545,45 @@ model* train(const problem *prob, const parameter *param)
 				for(; k<sub_prob.l; k++)
 					sub_prob.y[k] = -1;
 
-				train_one(&sub_prob, param, &model_->w[0], weighted_C[0], weighted_C[1]);
+				train_one(&sub_prob, sub_dense_x, param, &model_->w[0], weighted_C[0], weighted_C[1], next_seed(seed), sub_alpha);
 			}
 			else
 			{
 				model_->w=Malloc(double, w_size*nr_class);
-				double *w=Malloc(double, w_size);
+				// seeds are drawn in the order of classes, so the model
+				// doesn't depend on the number of threads
+				unsigned int *class_seed = Malloc(unsigned int, nr_class);
 				for(i=0;i<nr_class;i++)
-				{
-					int si = start[i];
-					int ei = si+count[i];
-
-					k=0;
-					for(; k<si; k++)
-						sub_prob.y[k] = -1;
-					for(; k<ei; k++)
-						sub_prob.y[k] = +1;
-					for(; k<sub_prob.l; k++)
-						sub_prob.y[k] = -1;
-
-					train_one(&sub_prob, param, w, weighted_C[i], param->C);
-
-					for(int j=0;j<w_size;j++)
-						model_->w[j*nr_class+i] = w[j];
-				}
-				free(w);
+					class_seed[i] = next_seed(seed);
+
+				one_vs_rest ovr;
+				ovr.prob = &sub_prob;
+				ovr.dense_x = sub_dense_x;
+				ovr.param = param;
+				ovr.nr_class = nr_class;
+				ovr.start = start;
+				ovr.count = count;
+				ovr.weighted_C = weighted_C;
+				ovr.seed = class_seed;
+				ovr.alpha = sub_alpha;
+				ovr.w = model_->w;
+
+				// classes are dealt to threads in turn, the calling thread takes the first
+				int nr_thread = min(max(param->nr_thread, 1), nr_class);
+				std::vector<std::thread> threads;
+				for(int t=1;t<nr_thread;t++)
+					threads.push_back(std::thread(train_one_vs_rest, &ovr, t, nr_thread));
+				train_one_vs_rest(&ovr, 0, nr_thread);
+				for(size_t t=0;t<threads.size();t++)
+					threads[t].join();
+				free(class_seed);
 			}
 
+			if(dual_sol)
+				for(k=0;k<nr_sub;k++)
+					for(i=0;i<l;i++)
+						dual_sol[(size_t)k*l+perm[i]] = sub_alpha[(size_t)k*l+i];
+			free(sub_alpha);
 		}
 
 		free(x);
@@ -2419,11 +2593,85 @@ model* train(const problem *prob, const parameter *param)
 		free(perm);
 		free(sub_prob.x);
 		free(sub_prob.y);
+		free(sub_dense_x);
 		free(weighted_C);
 	}
 	return model_;
 }
 
+//
+// Interface functions
+//
+model* train(const problem *prob, const parameter *param)
+{
+	return train_rows(prob, NULL, param, NULL, NULL);
+}
+
+// Dual SVC solvers read dense rows directly, the rest need feature_node arrays
+static bool reads_dense_rows(const parameter *param)
+{
+	return param->solver_type == L2R_L2LOSS_SVC_DUAL || param->solver_type == L2R_L1LOSS_SVC_DUAL;
+}
+
+// Sparse form of all rows of prob with all features kept, as train() sees them;
+// x gets prob->l row pointers, the returned nodes are to be freed after them
+static feature_node *dense_to_sparse(const dense_problem *prob, feature_node **x)
+{
+	int n = prob->n;
+	int nodes = prob->bias>=0 ? n+1 : n;
+	size_t row_nodes = (size_t)nodes+1;
+	feature_node *x_space = Malloc(feature_node,(size_t)prob->l*row_nodes);
+	for(int i=0;i<prob->l;i++)
+	{
+		const float *row = prob->x + (size_t)i*prob->stride;
+		feature_node *xi = x_space + (size_t)i*row_nodes;
+		for(int j=0;j<n;j++)
+		{
+			xi[j].index = j+1;
+			xi[j].value = row[j];
+		}
+		if(prob->bias>=0)
+		{
+			xi[n].index = n+1;
+			xi[n].value = prob->bias;
+		}
+		xi[nodes].index = -1;
+		x[i] = xi;
+	}
+	return x_space;
+}
+
+model* train_dense(const dense_problem *prob, const parameter *param)
+{
+	int i;
+	int l = prob->l;
+
+	// the same problem in sparse form, as train() sees it
+	problem sparse;
+	sparse.l = l;
+	sparse.n = prob->bias>=0 ? prob->n+1 : prob->n;
+	sparse.y = prob->y;
+	sparse.bias = prob->bias;
+
+	if(reads_dense_rows(param))
+	{
+		const float **x = Malloc(const float *,l);
+		for(i=0;i<l;i++)
+			x[i] = prob->x + (size_t)i*prob->stride;
+		sparse.x = NULL;
+		model *model_ = train_rows(&sparse, x, param, NULL, NULL);
+		free(x);
+		return model_;
+	}
+
+	sparse.x = Malloc(feature_node *,l);
+	feature_node *x_space = dense_to_sparse(prob, sparse.x);
+	model *model_ = train_rows(&sparse, NULL, param, NULL, NULL);
+	free(sparse.x);
+	free(x_space);
+	return model_;
+}
+
 void cross_validation(const problem *prob, const parameter *param, int nr_fold, double *target)
 {
 	int i;
@@ -2482,6 +2730,166 @@ void cross_validation(const problem *prob, const parameter *param, int nr_fold,
 	free(perm);
 }
 
+// Folds of cross_validation_dense(), read-only for all threads
+struct dense_folds
+{
+	const dense_problem *prob;
+	const parameter *param;		// nr_thread is for one fold
+	feature_node **sparse_x;	// rows for solvers that don't read dense ones
+	int nr_fold;
+	const int *fold;
+	const unsigned int *seed;	// seed of every fold
+	double *dual_sol;		// NULL or nr_class*l dual variables of every fold
+	size_t dual_size;
+	double *target;
+};
+
+// Trains folds first, first+step, ... and predicts samples of each by its model
+static void train_dense_folds(const dense_folds *cv, int first, int step)
+{
+	const dense_problem *prob = cv->prob;
+	int i, k;
+	int l = prob->l;
+	int n = prob->bias>=0 ? prob->n+1 : prob->n;
+
+	problem sub_prob;
+	sub_prob.n = n;
+	sub_prob.bias = prob->bias;
+	sub_prob.y = Malloc(double,l);
+	sub_prob.x = cv->sparse_x ? Malloc(feature_node *,l) : NULL;
+	const float **sub_dense_x = cv->sparse_x ? NULL : Malloc(const float *,l);
+	int *index = Malloc(int,l);
+	double *sub_alpha = cv->dual_sol ? Malloc(double,cv->dual_size) : NULL;
+	feature_node *row_x = cv->sparse_x ? NULL : Malloc(feature_node,n+1);
+
+	for(int f=first;f<cv->nr_fold;f+=step)
+	{
+		int sub_l = 0;
+		for(i=0;i<l;i++)
+			if(cv->fold[i] != f)
+			{
+				index[sub_l] = i;
+				sub_prob.y[sub_l] = prob->y[i];
+				if(cv->sparse_x)
+					sub_prob.x[sub_l] = cv->sparse_x[i];
+				else
+					sub_dense_x[sub_l] = prob->x + (size_t)i*prob->stride;
+				sub_l++;
+			}
+		sub_prob.l = sub_l;
+
+		// dual variables of the fold are kept l per sub-problem,
+		// the training rows pass them in their own order
+		double *fold_alpha = cv->dual_sol ? cv->dual_sol + (size_t)f*cv->dual_size : NULL;
+		int nr_sub = (int)(cv->dual_size/(size_t)l);
+		if(fold_alpha)
+			for(k=0;k<nr_sub;k++)
+				for(i=0;i<sub_l;i++)
+					sub_alpha[(size_t)k*sub_l+i] = fold_alpha[(size_t)k*l+index[i]];
+
+		unsigned int seed = cv->seed[f];
+		model *submodel = train_rows(&sub_prob, sub_dense_x, cv->param, &seed, sub_alpha);
+
+		if(fold_alpha)
+			for(k=0;k<nr_sub;k++)
+				for(i=0;i<sub_l;i++)
+					fold_alpha[(size_t)k*l+index[i]] = sub_alpha[(size_t)k*sub_l+i];
+
+		for(i=0;i<l;i++)
+		{
+			if(cv->fold[i] != f)
+				continue;
+			if(cv->sparse_x)
+			{
+				cv->target[i] = predict(submodel, cv->sparse_x[i]);
+				continue;
+			}
+			const float *row = prob->x + (size_t)i*prob->stride;
+			for(k=0;k<prob->n;k++)
+			{
+				row_x[k].index = k+1;
+				row_x[k].value = row[k];
+			}
+			if(prob->bias>=0)
+			{
+				row_x[prob->n].index = prob->n+1;
+				row_x[prob->n].value = prob->bias;
+			}
+			row_x[n].index = -1;
+			cv->target[i] = predict(submodel, row_x);
+		}
+		free_and_destroy_model(&submodel);
+	}
+	free(row_x);
+	free(sub_alpha);
+	free(index);
+	free(sub_dense_x);
+	free(sub_prob.x);
+	free(sub_prob.y);
+}
+
+void cross_validation_dense(const dense_problem *prob, const parameter *param, int nr_fold, const int *fold, double *target, double *dual_sol)
+{
+	int i;
+	int l = prob->l;
+
+	// seeds are drawn in the order of folds, so results
+	// don't depend on the number of threads
+	unsigned int *seed = Malloc(unsigned int,nr_fold);
+	for(i=0;i<nr_fold;i++)
+		seed[i] = (unsigned int)rand();
+
+	// folds are dealt to threads in turn, threads left over train classes of a fold
+	int nr_thread = min(max(param->nr_thread, 1), nr_fold);
+	parameter fold_param = *param;
+	fold_param.nr_thread = max(param->nr_thread/nr_thread, 1);
+
+	int nr_class = 0;
+	if(dual_sol)
+	{
+		int *label = Malloc(int,l);
+		for(i=0;i<l;i++)
+		{
+			int j;
+			for(j=0;j<nr_class;j++)
+				if(label[j] == (int)prob->y[i])
+					break;
+			if(j == nr_class)
+				label[nr_class++] = (int)prob->y[i];
+		}
+		free(label);
+	}
+
+	dense_folds cv;
+	cv.prob = prob;
+	cv.param = &fold_param;
+	cv.sparse_x = NULL;
+	cv.nr_fold = nr_fold;
+	cv.fold = fold;
+	cv.seed = seed;
+	cv.dual_sol = reads_dense_rows(param) ? dual_sol : NULL;
+	cv.dual_size = (size_t)nr_class*l;
+	cv.target = target;
+
+	feature_node *x_space = NULL;
+	if(!reads_dense_rows(param))
+	{
+		cv.sparse_x = Malloc(feature_node *,l);
+		x_space = dense_to_sparse(prob, cv.sparse_x);
+	}
+
+	std::vector<std::thread> threads;
+	for(int t=1;t<nr_thread;t++)
+		threads.push_back(std::thread(train_dense_folds, &cv, t, nr_thread));
+	train_dense_folds(&cv, 0, nr_thread);
+	for(size_t t=0;t<threads.size();t++)
+		threads[t].join();
+
+	free(cv.sparse_x);
+	free(x_space);
+	free(seed);
+}
+
 double predict_values(const struct model *model_, const struct feature_node *x, double *dec_values)
 {
 	int idx;
@@ -184,6 +184,7 @@ void parse_command_line(int argc, char **argv, char *input_file_name, char *mode
 	param.eps = INF; // see setting below
 	param.p = 0.1;
 	param.nr_weight = 0;
+	param.nr_thread = 1;
 	param.weight_label = NULL;
 	param.weight = NULL;
 	flag_cross_validation = 0;
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Memory provider for Matrix storage.
+//
+// Every block returned by allocate() is aligned to CACHE_LINE bytes,
+// so the first row of a freshly allocated matrix starts on a cache line.
+//
+// Both projects build on their own, so this file and src/allocator.cpp
+// have a copy in image_channel_alignment (like matrix.h): change them together.
+class MatrixAllocator
+{
+public:
+    static const size_t CACHE_LINE = 64;
+
+    virtual ~MatrixAllocator();
+
+    virtual void *allocate(size_t bytes) = 0;
+    virtual void deallocate(void *ptr, size_t bytes) = 0;
+
+    // Allocator used by matrices constructed without an explicit one.
+    // It is pool_allocator() unless changed with set_default().
+    static MatrixAllocator *get_default();
+    static void set_default(MatrixAllocator *allocator);
+};
+
+// Aligned heap allocation, every call goes straight to the system.
+class HeapAllocator : public MatrixAllocator
+{
+public:
+    void *allocate(size_t bytes);
+    void deallocate(void *ptr, size_t bytes);
+};
+
+// Pool of blocks keyed by size.
+//
+// Released blocks are not returned to the system but kept in a free list
+// and handed out to the next request of the same size, so chains of filters
+// over equally sized images reuse the same pages instead of calling malloc
+// (and page-faulting fresh memory) on every stage.
+// At most max_cached_bytes are kept, everything above is freed at once.
+class PoolAllocator : public MatrixAllocator
+{
+public:
+    explicit PoolAllocator(size_t max_cached_bytes = size_t(256) << 20);
+    ~PoolAllocator();
+
+    void *allocate(size_t bytes);
+    void deallocate(void *ptr, size_t bytes);
+
+    // Return all cached blocks to the system.
+    void release();
+    // Bytes currently sitting in free lists.
+    size_t cached_bytes() const;
+
+private:
+    PoolAllocator(const PoolAllocator&);
+    PoolAllocator &operator = (const PoolAllocator&);
+
+    const size_t max_cached;
+    size_t cached;
+    // size of block -> free blocks of that size
+    std::map<size_t, std::vector<void*>> free_blocks;
+    mutable std::mutex lock;
+};
+
+// Process-wide allocators. They are never destroyed, so static matrices
+// may safely release their storage at exit.
+HeapAllocator &heap_allocator();
+PoolAllocator &pool_allocator();
+
+// Deleter for shared_ptr: destroys elements and gives memory back
+// to the allocator it came from.
+template<typename ValueT>
+class StorageDeleter
+{
+public:
+    StorageDeleter(MatrixAllocator *alloc, size_t count):
+        allocator{alloc},
+        size{count}
+    {}
+
+    StorageDeleter(const StorageDeleter &src):
+        allocator{src.allocator},
+        size{src.size}
+    {}
+
+    StorageDeleter &operator = (const StorageDeleter &src)
+    {
+        allocator = src.allocator;
+        size = src.size;
+        return *this;
+    }
+
+    void operator () (ValueT *ptr) const
+    {
+        if (!std::is_trivially_destructible<ValueT>::value)
+            for (size_t i = 0; i < size; ++i)
+                ptr[i].~ValueT();
+        allocator->deallocate(ptr, size * sizeof(ValueT));
+    }
+
+private:
+    MatrixAllocator *allocator;
+    size_t size;
+};
+
+// Allocate and default-initialize count elements with the given allocator.
+template<typename ValueT>
+std::shared_ptr<ValueT> make_storage(size_t count, MatrixAllocator *allocator)
+{
+    ValueT *ptr = static_cast<ValueT*>(allocator->allocate(count * sizeof(ValueT)));
+    if (!std::is_trivially_default_constructible<ValueT>::value) {
+        size_t i = 0;
+        try {
+            for (; i < count; ++i)
+                new (ptr + i) ValueT;
+        } catch (...) {
+            while (i--)
+                ptr[i].~ValueT();
+            allocator->deallocate(ptr, count * sizeof(ValueT));
+            throw;
+        }
+    }
+    return std::shared_ptr<ValueT>(ptr, StorageDeleter<ValueT>(allocator, count));
+}
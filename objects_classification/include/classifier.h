@@ -1,6 +1,7 @@
 #ifndef CLASSIFIER_H_
 #define CLASSIFIER_H_
 
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <cstdlib>
@@ -8,13 +9,14 @@
 #include <memory>
 
 #include "linear.h"
+#include "dense_model.h"
+#include "feature_matrix.h"
 
 using std::vector;
 using std::pair;
 using std::string;
 using std::shared_ptr;
 
-typedef vector<pair<vector<float>, int> > TFeatures;
 typedef vector<int> TLabels;
 
 // Model of classifier to be trained
@@ -57,6 +59,9 @@ struct TClassifierParams {
     int nr_weight;
     int* weight_label;
     double* weight;
+        // Threads for one-vs-rest training and cross validation folds,
+        // results don't depend on it
+    int nr_thread;
 
     TClassifierParams() {
         bias = -1;
@@ -66,6 +71,7 @@ struct TClassifierParams {
         nr_weight = 0;
         weight_label = NULL;
         weight = NULL;
+        nr_thread = 1;
     }
 };
 
@@ -74,41 +80,29 @@ class TClassifier {
         // Parameters of classifier
     TClassifierParams params_;
 
- public:
-        // Basic constructor
-    TClassifier(const TClassifierParams& params): params_(params) {}
-
-        // Train classifier
-    void Train(const TFeatures& features, TModel* model) {
+        // Description of one problem: the solver reads rows of
+        // 'features' in place (see train_dense), nothing is copied.
+        // prob->y is to be deleted by the caller
+    void Problem(const TFeatures& features, struct dense_problem* prob) const {
             // Number of samples and features must be nonzero
-        size_t number_of_samples = features.size();
+        size_t number_of_samples = features.Samples();
         assert(number_of_samples > 0);
 
-        size_t number_of_features = features[0].first.size();
+        size_t number_of_features = features.Dim();
         assert(number_of_features > 0);
 
-            // Description of one problem
-        struct problem prob;
-        prob.l = number_of_samples;
-        prob.bias = -1;
-        prob.n = number_of_features;
-        prob.y = new double[number_of_samples];
-        prob.x = new struct feature_node*[number_of_samples];
-
-            // Fill struct problem
+        prob->l = number_of_samples;
+        prob->bias = -1;
+        prob->n = number_of_features;
+        prob->y = new double[number_of_samples];
+        prob->x = features.Row(0);
+        prob->stride = features.Stride();
         for (size_t sample_idx = 0; sample_idx < number_of_samples; ++sample_idx)
-        {
-            prob.x[sample_idx] = new struct feature_node[number_of_features + 1];
-            for (unsigned int feature_idx = 0; feature_idx < number_of_features; feature_idx++)
-            {
-                prob.x[sample_idx][feature_idx].index = feature_idx + 1;
-                prob.x[sample_idx][feature_idx].value = features[sample_idx].first[feature_idx];
-            }
-            prob.x[sample_idx][number_of_features].index = -1;
-            prob.y[sample_idx] = features[sample_idx].second;
-        }
+            prob->y[sample_idx] = features.Label(sample_idx);
+    }
 
-            // Fill param structure by values from 'params_'
+        // Fill param structure by values from 'params_'
+    struct parameter Parameter() const {
         struct parameter param;
         param.solver_type = params_.solver_type;
         param.C = params_.C;      // try to vary it
@@ -116,38 +110,65 @@ class TClassifier {
         param.nr_weight = params_.nr_weight;
         param.weight_label = params_.weight_label;
         param.weight = params_.weight;
+        param.nr_thread = params_.nr_thread;
+        return param;
+    }
+
+ public:
+        // Basic constructor
+    TClassifier(const TClassifierParams& params): params_(params) {}
+
+        // Train classifier
+    void Train(const TFeatures& features, TModel* model) {
+        struct dense_problem prob;
+        Problem(features, &prob);
+        struct parameter param = Parameter();
 
             // Train model
-        *model = train(&prob, &param);
+        *model = train_dense(&prob, &param);
 
             // Clear param structure
         destroy_param(&param);
             // clear problem structure
         delete[] prob.y;
-        for (unsigned int sample_idx = 0; sample_idx < number_of_samples; ++sample_idx)
-            delete[] prob.x[sample_idx];
-        delete[] prob.x;
     }
 
-        // Predict data
+        // Cross validation: sample i is predicted by the model trained on
+        // samples of all folds but fold[i], labels go to 'labels' in the order
+        // of samples. 'dual' keeps dual variables of the solver between calls
+        // with different C, so every next call starts from the previous
+        // solution; it is to be empty at the first call
+    void CrossValidate(const TFeatures& features, const vector<int>& fold, int folds,
+                       vector<double>* dual, TLabels* labels) {
+        struct dense_problem prob;
+        Problem(features, &prob);
+        struct parameter param = Parameter();
+
+        if (dual->empty()) {
+            vector<int> classes(prob.y, prob.y + prob.l);
+            std::sort(classes.begin(), classes.end());
+            size_t classes_count = std::unique(classes.begin(), classes.end()) - classes.begin();
+            dual->assign(folds * classes_count * prob.l, 0.0);
+        }
+        vector<double> target(prob.l);
+        cross_validation_dense(&prob, &param, folds, fold.data(), target.data(), dual->data());
+        labels->assign(target.begin(), target.end());
+
+        destroy_param(&param);
+        delete[] prob.y;
+    }
+
+        // Predict data: decision values of all samples at once by dense
+        // float32 product with the weights (see TDenseModel), labels are
+        // the same as liblinear predict() gives
     void Predict(const TFeatures& features, const TModel& model, TLabels* labels) {
             // Number of samples and features must be nonzero
-        size_t number_of_samples = features.size();
+        size_t number_of_samples = features.Samples();
         assert(number_of_samples > 0);
-        size_t number_of_features = features[0].first.size();
+        size_t number_of_features = features.Dim();
         assert(number_of_features > 0);
 
-            // Fill struct problem
-        struct feature_node* x = new struct feature_node[number_of_features + 1];
-        for (size_t sample_idx = 0; sample_idx < features.size(); ++sample_idx) {
-            for (unsigned int feature_idx = 0; feature_idx < number_of_features; ++feature_idx) {
-                x[feature_idx].index = feature_idx + 1;
-                x[feature_idx].value = features[sample_idx].first[feature_idx];
-            }
-            x[number_of_features].index = -1;
-                // Add predicted label to labels structure
-            labels->push_back(predict(model.get(), x));
-        }
+        TDenseModel(model.get()).Predict(features, labels);
     }
 };
 
@@ -0,0 +1,68 @@
+#ifndef DENSE_MODEL_H_
+#define DENSE_MODEL_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "feature_matrix.h"
+#include "linear.h"
+
+// Linear model of liblinear prepared for dense features.
+//
+// liblinear interleaves weights of decision functions feature by feature
+// and predicts one sparse sample at a time. Here weights of every function
+// are contiguous float32 rows, so decision values of a batch of samples are
+// one product of the feature matrix with the transposed weight matrix,
+// computed in blocks of samples and features that stay in cache.
+//
+// Labels are the same as liblinear predict() gives: float32 rounding error
+// of every decision value is bounded, and samples whose decision is closer
+// to a tie than the bound are predicted by liblinear itself.
+class TDenseModel {
+ public:
+    explicit TDenseModel(const struct model* model);
+
+        // Number of features the model was trained on
+    size_t Dim() const {
+        return dim_;
+    }
+        // Number of decision functions: one for two classes (except
+        // Crammer-Singer), one per class otherwise
+    size_t Functions() const {
+        return functions_;
+    }
+        // Dim() weights of function 'k'
+    const float* Weights(size_t k) const {
+        return weights_.data() + k * dim_;
+    }
+        // Constant term of function 'k', zero if the model has no bias
+    float Bias(size_t k) const {
+        return bias_[k];
+    }
+
+        // Label for decision values 'values' of all functions, as liblinear
+        // decides; its decision value goes to 'score' (for one function
+        // it is negated for the second label)
+    int Label(const float* values, float* score) const;
+
+        // Appends predicted labels of all samples of 'features' to 'labels'
+    void Predict(const TFeatures& features, std::vector<int>* labels) const;
+
+ private:
+        // Decision values and their error bounds for rows [first, first + count)
+    void DecisionValues(const TFeatures& features, size_t first, size_t count,
+                        float* values, float* bounds) const;
+        // Label by liblinear predict(), for samples too close to a tie
+    int ExactLabel(const float* row, size_t features_dim) const;
+
+    const struct model* model_;
+    size_t dim_;
+    size_t functions_;
+    std::vector<float> weights_;
+    std::vector<float> bias_;
+        // Euclidean norms of weights of every function
+    std::vector<float> norms_;
+    std::vector<int> labels_;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef FEATURE_CACHE_H_
+#define FEATURE_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// On-disk cache of image descriptors, so that runs over the same dataset
+// (e.g. training with different C) don't extract features again.
+//
+// An entry is keyed by the image path, its modification time and size;
+// the whole cache is tied to descriptor length and 'config', a number which
+// must change whenever feature extraction changes. Entries with other
+// length or config are not used.
+//
+// File layout (native byte order, it is a cache, not an exchange format):
+//   header: "FCH1", layout version, config (uint64), dim, count (uint32)
+//   count records: path length, mtime in ns, file size (uint64 each),
+//                  path padded with zeros to a multiple of 8 bytes,
+//                  dim floats of descriptor
+// The file is mapped into memory, descriptors are copied straight from it.
+class TFeatureCache {
+ public:
+        // Opens cache 'path', missing or unsuitable file means empty cache
+    TFeatureCache(const std::string& path, size_t dim, uint64_t config);
+
+        // Copies cached descriptor of 'image_path' into 'desc'.
+        // Returns false if there is none or the image has changed since.
+    bool Lookup(const std::string& image_path, float* desc) const;
+        // Remembers descriptor of 'image_path'; safe to call from many threads
+    void Store(const std::string& image_path, const float* desc);
+        // Writes old and new entries back to the file if anything was stored
+    void Save();
+
+ private:
+    TFeatureCache(const TFeatureCache&);
+    TFeatureCache& operator=(const TFeatureCache&);
+
+    struct TKey {
+        std::string path;
+        uint64_t mtime;
+        uint64_t size;
+    };
+
+        // Key of image file, false if it can't be stat'ed
+    static bool MakeKey(const std::string& image_path, TKey* key);
+        // Bytes of a record with path of 'path_length' bytes
+    size_t RecordSize(size_t path_length) const;
+    const float* Find(const TKey& key) const;
+
+    std::string path_;
+    size_t dim_;
+    uint64_t config_;
+        // Mapped file, if any, and offsets of its records by path
+    std::shared_ptr<unsigned char> mapping_;
+    std::unordered_map<std::string, size_t> index_;
+        // Records stored in this run: keys and descriptors
+    std::mutex mutex_;
+    std::vector<TKey> new_keys_;
+    std::vector<float> new_values_;
+};
+
+#endif
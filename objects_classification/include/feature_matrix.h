@@ -0,0 +1,107 @@
+#ifndef FEATURE_MATRIX_H_
+#define FEATURE_MATRIX_H_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Descriptors of all samples in one contiguous row-major block.
+// Row i holds Dim() features of sample i, Label(i) is its class.
+// Memory for all rows is allocated at once by the constructor or Resize(),
+// so extraction writes descriptors in place without per-sample allocations.
+// Rows may also live in a mapped feature matrix file, see MapFeatures().
+class TFeatures {
+ public:
+        // Empty set
+    TFeatures(): dim_(0), stride_(0), data_(), labels_() {}
+        // 'samples' rows of 'dim' zero features
+    TFeatures(size_t samples, size_t dim): dim_(0), stride_(0), data_(), labels_() {
+        Resize(samples, dim);
+    }
+        // Rows over external memory: row i starts at first_row + i * stride,
+        // 'data' keeps the memory alive
+    TFeatures(const std::shared_ptr<float>& first_row, size_t dim, size_t stride,
+              const std::vector<int>& labels):
+        dim_(dim), stride_(stride), data_(first_row), labels_(labels) {}
+
+        // Reallocate for 'samples' rows of 'dim' features, all zero
+    void Resize(size_t samples, size_t dim) {
+        dim_ = dim;
+        stride_ = dim;
+        data_.reset(new float[samples * dim](), std::default_delete<float[]>());
+        labels_.assign(samples, 0);
+    }
+
+        // Number of samples
+    size_t Samples() const {
+        return labels_.size();
+    }
+        // Number of features of every sample
+    size_t Dim() const {
+        return dim_;
+    }
+
+        // Distance between rows, in floats
+    size_t Stride() const {
+        return stride_;
+    }
+
+        // Features of sample 'idx'
+    float* Row(size_t idx) {
+        assert(idx < Samples());
+        return data_.get() + idx * stride_;
+    }
+    const float* Row(size_t idx) const {
+        assert(idx < Samples());
+        return data_.get() + idx * stride_;
+    }
+
+        // Label of sample 'idx'
+    int& Label(size_t idx) {
+        return labels_[idx];
+    }
+    int Label(size_t idx) const {
+        return labels_[idx];
+    }
+
+ private:
+    size_t dim_;
+        // Distance between rows, in floats
+    size_t stride_;
+    std::shared_ptr<float> data_;
+    std::vector<int> labels_;
+};
+
+// Feature matrix file: dense row-major float32 matrix of all samples,
+// one row per sample, label stored as one of the columns.
+//
+// Layout (native byte order):
+//   header: "FMAT", format version (uint32), features config (uint64),
+//           rows (uint64), cols (uint32), label column (uint32)
+//   rows * cols floats
+// Features config identifies how descriptors were extracted (the same
+// number as in the feature cache), so that a file made by other
+// extraction code is not mixed with fresh descriptors.
+// Files are written with the label in the last column.
+
+struct TFeatureFileInfo {
+    uint32_t version;
+    uint64_t config;
+    uint64_t rows;
+    uint32_t cols;
+    uint32_t label_column;
+};
+
+// Writes 'features' to 'path'. Throws std::string on error.
+void SaveFeatures(const TFeatures& features, uint64_t config, const std::string& path);
+
+// Maps file 'path' into memory, rows of the result point into the mapping
+// (written rows are copied on write and never reach the file).
+// Only labels are read eagerly. Throws std::string if the file can't be
+// read or isn't a feature matrix; 'info' receives the header if not NULL.
+TFeatures MapFeatures(const std::string& path, TFeatureFileInfo* info = NULL);
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef HOG_H_
+#define HOG_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "matrix.h"
+
+// Histograms of oriented gradients after Dalal and Triggs.
+//
+// Gradients are central differences of a grayscale image with a border of
+// one pixel (replicated edges). Unsigned orientation [0, pi) is split into
+// Bins() bins. Every pixel votes with its gradient magnitude into the two
+// nearest orientation bins and the four nearest cells (trilinear
+// interpolation), cells may have any, even fractional, size. Descriptor is
+// made of overlapping 2x2 cell blocks with a stride of one cell, every
+// block normalised with L2-Hys.
+//
+// Interpolation weights depend only on pixel coordinates, so they are
+// precomputed per row and column once per image, before the pixel loop.
+// An engine keeps its tables and histograms between calls, use one engine
+// per thread.
+class THogEngine {
+ public:
+    explicit THogEngine(size_t bins);
+
+        // Fills cell histograms of 'grid_rows' x 'grid_cols' cells of
+        // 'cell_h' x 'cell_w' pixels from the top left corner of 'gray'
+        // (which includes the border). Pixels beyond the grid are ignored.
+    void ComputeCells(const Matrix<float>& gray, float cell_h, float cell_w,
+                      size_t grid_rows, size_t grid_cols);
+
+        // Descriptor of 'rows' x 'cols' cells starting from cell
+        // (row, col) of the last computed grid, DescriptorSize(rows, cols)
+        // floats are written to 'desc'
+    void Describe(size_t row, size_t col, size_t rows, size_t cols, float* desc) const;
+
+        // Cell histograms, Bins() floats per cell, cells row by row
+    const float* Cell(size_t row, size_t col) const {
+        return cells_.data() + (row * grid_cols_ + col) * bins_;
+    }
+
+    size_t Bins() const {
+        return bins_;
+    }
+    size_t GridRows() const {
+        return grid_rows_;
+    }
+    size_t GridCols() const {
+        return grid_cols_;
+    }
+
+        // Length of descriptor of 'rows' x 'cols' cells
+    size_t DescriptorSize(size_t rows, size_t cols) const;
+
+ private:
+        // Pixel votes into cells 'first' and 'first' + 1 along one axis
+        // with weights 'near' and 'far'; cells out of the grid get no votes
+    struct TAxisWeight {
+        int first;
+        float near;
+        float far;
+    };
+
+        // Gradients of pixels 1..cols of row 'cur' (rows 'prev' and 'next'
+        // are above and below it) into magnitude_, first_bin_ and upper_
+    void GradientRow(const float* prev, const float* cur, const float* next, size_t cols);
+
+    static void AxisWeights(size_t pixels, float cell_size, size_t cells,
+                            std::vector<TAxisWeight>* weights);
+
+    size_t bins_;
+    size_t grid_rows_;
+    size_t grid_cols_;
+    std::vector<float> cells_;
+        // Votes of the last grid with one extra row and column of cells,
+        // so that pixels of the last cells may vote past them with zero weight
+    std::vector<float> votes_;
+        // Weight tables of pixel rows and columns
+    std::vector<TAxisWeight> row_weights_;
+    std::vector<TAxisWeight> col_weights_;
+        // Gradients of one row: magnitudes, the lower of two orientation
+        // bins and the weight of the upper one
+    std::vector<float> magnitude_;
+    std::vector<int> first_bin_;
+    std::vector<float> upper_;
+        // Votes of one row into a row of cells
+    std::vector<float> row_votes_;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef IMAGE_LOADER_H_
+#define IMAGE_LOADER_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "EasyBMP.h"
+#include "thread_pool.h"
+
+typedef std::vector<std::pair<std::string, int> > TFileList;
+
+// Decoded image and its place in the file list
+struct TLoadedImage {
+    size_t index;
+    int label;
+    std::unique_ptr<BMP> image;
+
+    TLoadedImage(): index(0), label(0), image() {}
+};
+
+// Decodes images of a file list on several threads and hands every image
+// to a callback on the thread which decoded it. Images are spread over
+// threads by TWorkStealingPool, so they are processed in no particular
+// order, use TLoadedImage::index to put results in place.
+// An image is freed as soon as the callback returns, so at most one
+// decoded image per thread exists at a time, whatever the dataset size.
+class TImageLoader {
+ public:
+    TImageLoader(const TFileList& file_list, size_t threads):
+        file_list_(file_list), pool_(threads) {}
+
+        // Calls process(loaded, worker) for every image of the list,
+        // 'worker' is in [0, Threads()), see TWorkStealingPool::Run
+    void ForEach(const std::function<void(TLoadedImage& loaded, size_t worker)>& process);
+
+    size_t Threads() const {
+        return pool_.Threads();
+    }
+
+ private:
+    const TFileList& file_list_;
+    TWorkStealingPool pool_;
+};
+
+#endif
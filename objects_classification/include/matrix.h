@@ -8,8 +8,22 @@
 #include <string>
 #include <type_traits>
 
+#include "allocator.h"
+
 typedef unsigned int uint;
 
+// Lazy elementwise expression, see matrix_expr.h
+template<typename Derived> class MatrixExpr;
+
+// Layout of matrix rows in memory.
+//
+// Packed: rows go back to back, stride equals the number of columns.
+// Aligned: stride is rounded up so that every row starts on a cache line
+// boundary (MatrixAllocator::CACHE_LINE bytes). Padding elements at the end
+// of rows are never visited. Use it for images processed row by row
+// with SIMD loads.
+enum class MatrixLayout { Packed, Aligned };
+
 template<typename ValueT>
 class Matrix
 {
@@ -19,8 +33,18 @@ public:
 	// Number of cols
 	const uint n_cols;
 
-	// Construct matrix with row_count of rows and col_count of columns
-	Matrix(uint row_count = 0, uint col_count = 0);
+	// Construct matrix with row_count of rows and col_count of columns.
+	// Memory is taken from allocator, by default it is the shared pool
+	// (see allocator.h), so temporaries of the same size are recycled.
+	Matrix(uint row_count = 0, uint col_count = 0,
+		MatrixAllocator *allocator = MatrixAllocator::get_default());
+
+	// Same, but with explicit layout of rows (see MatrixLayout).
+	//
+	// Example:
+	// FImage gray(480, 640, MatrixLayout::Aligned);
+	Matrix(uint row_count, uint col_count, MatrixLayout layout,
+		MatrixAllocator *allocator = MatrixAllocator::get_default());
 
 	// Construct and initialize matrix which consists of one row.
 	//
@@ -38,12 +62,23 @@ public:
 	// Shallow copy. Be careful, this function just copies the pointer
 	// to data and doesn't allocate any memory for data!
 	Matrix(const Matrix&);
-	// Deep copy. Allocates memory and copies all values
+	// Deep copy. Allocates memory and copies all values.
+	// The copy has the same layout of rows as the source.
 	Matrix<ValueT> deep_copy() const;
 
 	// Assignment operator
 	const Matrix<ValueT> &operator = (const Matrix<ValueT> &);
 
+	// Evaluate elementwise expression (include matrix_expr.h to use).
+	// Elements are computed in one pass and converted to ValueT.
+	//
+	// Example:
+	// FImage magnitude = sqrt(gx * gx + gy * gy);
+	template<typename Expr>
+	Matrix(const MatrixExpr<Expr> &);
+	template<typename Expr>
+	const Matrix<ValueT> &operator = (const MatrixExpr<Expr> &);
+
 	// Move copy constructor. Needed when copy temporary object.
 	// It is from c++ 11 standard.
 	Matrix(Matrix && );
@@ -63,6 +98,15 @@ public:
 	// cout << a; // 9 3 7
 	ValueT &operator() (uint row, uint col);
 
+	// Raw access to rows for inner loops, no bounds checking.
+	// row(i)[j] is the same element as (*this)(i, j); row(i + 1) starts
+	// row_stride() elements after row(i). For a matrix with Aligned layout
+	// (and its submatrices starting at column 0) row(i) is cache line aligned.
+	ValueT *row(uint i);
+	const ValueT *row(uint i) const;
+	uint row_stride() const;
+	MatrixLayout layout() const;
+
 	// Matrix convolution.
 	//
 	// You give this function a unary operator. Operator _must_
@@ -132,6 +176,13 @@ private:
 	// so, for now we use shared_ptr just for counting links,
 	// and work with raw pointer through get().
 	std::shared_ptr<ValueT> _data;
+	// Where the data came from. Copies made by deep_copy() use it too.
+	MatrixAllocator *_allocator;
+	// Layout the storage was allocated with, submatrices share it.
+	MatrixLayout _layout;
+
+	// Stride of a row of col_count elements in Aligned layout.
+	static uint aligned_stride(uint col_count);
 
 	// Const cast for writing public const fields.
 	template<typename T> inline T& make_rw(const T& val) const;	
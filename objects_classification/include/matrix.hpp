@@ -7,17 +7,40 @@ inline
 }
 
 template<typename ValueT>
-Matrix<ValueT>::Matrix(uint row_count, uint col_count) :
+uint Matrix<ValueT>::aligned_stride(uint col_count)
+{
+	// smallest number of elements which fill a whole number of cache lines
+	size_t a = MatrixAllocator::CACHE_LINE, b = sizeof(ValueT);
+	while (b) {
+		size_t t = a % b;
+		a = b;
+		b = t;
+	}
+	uint step = MatrixAllocator::CACHE_LINE / a;
+	return (col_count + step - 1) / step * step;
+}
+
+template<typename ValueT>
+Matrix<ValueT>::Matrix(uint row_count, uint col_count, MatrixAllocator *allocator) :
+	Matrix(row_count, col_count, MatrixLayout::Packed, allocator)
+{
+}
+
+template<typename ValueT>
+Matrix<ValueT>::Matrix(uint row_count, uint col_count, MatrixLayout layout,
+	MatrixAllocator *allocator) :
 	n_rows{ row_count },
 	n_cols{ col_count },
-	stride{ n_cols },
+	stride{ layout == MatrixLayout::Aligned ? aligned_stride(col_count) : col_count },
 	pin_row{ 0 },
 	pin_col{ 0 },
-	_data{}
+	_data{},
+	_allocator{ allocator },
+	_layout{ layout }
 {
-	auto size = n_cols * n_rows;
+	auto size = stride * n_rows;
 	if (size)
-		_data.reset(new ValueT[size], std::default_delete<ValueT []>());
+		_data = make_storage<ValueT>(size, _allocator);
 }
 
 template<typename ValueT>
@@ -27,10 +50,12 @@ Matrix<ValueT>::Matrix(std::initializer_list<ValueT> lst) :
 	stride{ n_cols },
 	pin_row{ 0 },
 	pin_col{ 0 },
-	_data{}
+	_data{},
+	_allocator{ MatrixAllocator::get_default() },
+	_layout{ MatrixLayout::Packed }
 {
 	if (n_cols) {
-		_data.reset(new ValueT[n_cols], std::default_delete<ValueT []>());
+		_data = make_storage<ValueT>(n_cols, _allocator);
 		std::copy(lst.begin(), lst.end(), _data.get());
 	}
 }
@@ -38,10 +63,9 @@ Matrix<ValueT>::Matrix(std::initializer_list<ValueT> lst) :
 template<typename ValueT>
 Matrix<ValueT> Matrix<ValueT>::deep_copy() const
 {
-	Matrix<ValueT> tmp(n_rows, n_cols);
+	Matrix<ValueT> tmp(n_rows, n_cols, _layout, _allocator);
 	for (uint i = 0; i < n_rows; ++i)
-		for (uint j = 0; j < n_cols; ++j)
-			tmp(i, j) = (*this)(i, j);
+		std::copy(row(i), row(i) + n_cols, tmp.row(i));
 	return tmp;
 }
 
@@ -54,6 +78,8 @@ const Matrix<ValueT> &Matrix<ValueT>::operator = (const Matrix<ValueT> &m)
 	make_rw(pin_row) = m.pin_row;
 	make_rw(pin_col) = m.pin_col;
 	_data = m._data;
+	_allocator = m._allocator;
+	_layout = m._layout;
 	return *this;
 }
 template<typename ValueT>
@@ -63,7 +89,9 @@ Matrix<ValueT>::Matrix(std::initializer_list < std::initializer_list < ValueT >>
 	stride{ n_cols },
 	pin_row{ 0 },
 	pin_col{ 0 },
-	_data{}
+	_data{},
+	_allocator{ MatrixAllocator::get_default() },
+	_layout{ MatrixLayout::Packed }
 {
 	// check if no action is needed.
 	if (n_rows == 0)
@@ -89,7 +117,7 @@ Matrix<ValueT>::Matrix(std::initializer_list < std::initializer_list < ValueT >>
 		return;
 
 	// allocating matrix memory.
-	_data.reset(new ValueT[n_cols * n_rows], std::default_delete<ValueT []>());
+	_data = make_storage<ValueT>(n_cols * n_rows, _allocator);
 
 	// copying matrix data.
 	{
@@ -110,7 +138,9 @@ Matrix<ValueT>::Matrix(const Matrix &src) :
 	stride{ src.stride },
 	pin_row{ src.pin_row },
 	pin_col{ src.pin_col },
-	_data{ src._data }
+	_data{ src._data },
+	_allocator{ src._allocator },
+	_layout{ src._layout }
 {
 }
 
@@ -121,7 +151,9 @@ Matrix<ValueT>::Matrix(Matrix && src) :
 	stride{ src.stride },
 	pin_row{ src.pin_row },
 	pin_col{ src.pin_col },
-	_data{ src._data }
+	_data{ src._data },
+	_allocator{ src._allocator },
+	_layout{ src._layout }
 {
 	// resetting state of donor object.
 	make_rw(src.n_rows) = 0;
@@ -153,6 +185,30 @@ const ValueT &Matrix<ValueT>::operator()(uint row, uint col) const
 	return _data.get()[row * stride + col];
 }
 
+template<typename ValueT>
+ValueT *Matrix<ValueT>::row(uint i)
+{
+	return _data.get() + (i + pin_row) * stride + pin_col;
+}
+
+template<typename ValueT>
+const ValueT *Matrix<ValueT>::row(uint i) const
+{
+	return _data.get() + (i + pin_row) * stride + pin_col;
+}
+
+template<typename ValueT>
+uint Matrix<ValueT>::row_stride() const
+{
+	return stride;
+}
+
+template<typename ValueT>
+MatrixLayout Matrix<ValueT>::layout() const
+{
+	return _layout;
+}
+
 template<typename ValueT>
 Matrix<ValueT>::~Matrix()
 {}
@@ -0,0 +1,380 @@
+#pragma once
+
+// Lazy elementwise arithmetic over matrices (expression templates).
+//
+// Operators + - * /, sqrt, atan2, clamp and cast applied to matrices
+// don't compute anything, they build a small expression object. The
+// expression is evaluated when it is assigned to a Matrix, in one loop over
+// rows and columns without temporary matrices, so the compiler is free to
+// vectorize it.
+//
+// Example:
+// FImage gx = ..., gy = ...;
+// FImage magnitude = sqrt(gx * gx + gy * gy); // one pass, no temporaries
+// FImage scaled = clamp(magnitude * 0.5f, 0.0f, 255.0f);
+//
+// Operands of an expression must have equal sizes, scalars are broadcast.
+// Matrices are held by shallow copy, so an expression may be stored
+// in a variable and evaluated later.
+
+#include <cmath>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "matrix.h"
+
+// Common base of all expressions, used to recognize them in operators.
+class MatrixExprBase
+{
+};
+
+// Every expression Derived provides:
+// value_type - type of elements;
+// row_type - cheap object with operator[](uint col) for one row;
+// rows(), cols() - size (0 x 0 for scalars);
+// row(i) - row_type for the i-th row.
+template<typename Derived>
+class MatrixExpr : public MatrixExprBase
+{
+public:
+	const Derived &self() const
+	{
+		return static_cast<const Derived&>(*this);
+	}
+};
+
+// Matrix as a leaf of expression
+template<typename ValueT>
+class MatrixTerminal : public MatrixExpr<MatrixTerminal<ValueT> >
+{
+public:
+	typedef ValueT value_type;
+	typedef const ValueT *row_type;
+
+	explicit MatrixTerminal(const Matrix<ValueT> &m) : matrix(m) {}
+
+	uint rows() const { return matrix.n_rows; }
+	uint cols() const { return matrix.n_cols; }
+	row_type row(uint i) const { return matrix.row(i); }
+
+private:
+	Matrix<ValueT> matrix;
+};
+
+// Scalar broadcast to any size
+template<typename ValueT>
+class ScalarTerminal : public MatrixExpr<ScalarTerminal<ValueT> >
+{
+public:
+	typedef ValueT value_type;
+
+	class row_type
+	{
+	public:
+		explicit row_type(ValueT v) : value(v) {}
+		ValueT operator[] (uint) const { return value; }
+	private:
+		ValueT value;
+	};
+
+	explicit ScalarTerminal(ValueT v) : value(v) {}
+
+	uint rows() const { return 0; }
+	uint cols() const { return 0; }
+	row_type row(uint) const { return row_type(value); }
+
+private:
+	ValueT value;
+};
+
+template<typename Arg, typename Op>
+class UnaryExpr : public MatrixExpr<UnaryExpr<Arg, Op> >
+{
+public:
+	typedef decltype(std::declval<Op>()(std::declval<typename Arg::value_type>())) value_type;
+
+	class row_type
+	{
+	public:
+		row_type(const typename Arg::row_type &a, const Op &o) : arg_row(a), op(o) {}
+		value_type operator[] (uint j) const { return op(arg_row[j]); }
+	private:
+		typename Arg::row_type arg_row;
+		Op op;
+	};
+
+	UnaryExpr(const Arg &a, const Op &o) : arg(a), op(o) {}
+
+	uint rows() const { return arg.rows(); }
+	uint cols() const { return arg.cols(); }
+	row_type row(uint i) const { return row_type(arg.row(i), op); }
+
+private:
+	Arg arg;
+	Op op;
+};
+
+template<typename Left, typename Right, typename Op>
+class BinaryExpr : public MatrixExpr<BinaryExpr<Left, Right, Op> >
+{
+public:
+	typedef decltype(std::declval<Op>()(std::declval<typename Left::value_type>(),
+		std::declval<typename Right::value_type>())) value_type;
+
+	class row_type
+	{
+	public:
+		row_type(const typename Left::row_type &l, const typename Right::row_type &r, const Op &o) :
+			left_row(l), right_row(r), op(o) {}
+		value_type operator[] (uint j) const { return op(left_row[j], right_row[j]); }
+	private:
+		typename Left::row_type left_row;
+		typename Right::row_type right_row;
+		Op op;
+	};
+
+	BinaryExpr(const Left &l, const Right &r, const Op &o) : left(l), right(r), op(o)
+	{
+		// scalars have zero size and fit anything
+		if (l.rows() * l.cols() != 0 && r.rows() * r.cols() != 0 &&
+			(l.rows() != r.rows() || l.cols() != r.cols()))
+			throw std::string("Matrix sizes don't match");
+	}
+
+	uint rows() const { return left.rows() ? left.rows() : right.rows(); }
+	uint cols() const { return left.cols() ? left.cols() : right.cols(); }
+	row_type row(uint i) const { return row_type(left.row(i), right.row(i), op); }
+
+private:
+	Left left;
+	Right right;
+	Op op;
+};
+
+// Elementwise operations
+struct ExprAdd
+{
+	template<typename A, typename B>
+	auto operator() (A a, B b) const -> decltype(a + b) { return a + b; }
+};
+
+struct ExprSub
+{
+	template<typename A, typename B>
+	auto operator() (A a, B b) const -> decltype(a - b) { return a - b; }
+};
+
+struct ExprMul
+{
+	template<typename A, typename B>
+	auto operator() (A a, B b) const -> decltype(a * b) { return a * b; }
+};
+
+struct ExprDiv
+{
+	template<typename A, typename B>
+	auto operator() (A a, B b) const -> decltype(a / b) { return a / b; }
+};
+
+struct ExprNeg
+{
+	template<typename A>
+	auto operator() (A a) const -> decltype(-a) { return -a; }
+};
+
+struct ExprSqrt
+{
+	template<typename A>
+	auto operator() (A a) const -> decltype(std::sqrt(a)) { return std::sqrt(a); }
+};
+
+struct ExprAtan2
+{
+	template<typename A, typename B>
+	auto operator() (A y, B x) const -> decltype(std::atan2(y, x)) { return std::atan2(y, x); }
+};
+
+template<typename ValueT>
+struct ExprClamp
+{
+	ExprClamp(ValueT low, ValueT high) : lo(low), hi(high) {}
+	ValueT operator() (ValueT a) const { return a < lo ? lo : (a > hi ? hi : a); }
+	ValueT lo, hi;
+};
+
+template<typename To>
+struct ExprCast
+{
+	template<typename A>
+	To operator() (A a) const { return static_cast<To>(a); }
+};
+
+// Conversion of operands to expressions: matrices become MatrixTerminal,
+// arithmetic values become ScalarTerminal, expressions stay as they are.
+// For other types there is no 'type', so operators below don't apply.
+template<typename T, typename Enable = void>
+struct ToExpr
+{
+	static const bool is_operand = false;
+	static const bool is_matrix = false;
+};
+
+template<typename ValueT>
+struct ToExpr<Matrix<ValueT> >
+{
+	static const bool is_operand = true;
+	static const bool is_matrix = true;
+	typedef MatrixTerminal<ValueT> type;
+	static type make(const Matrix<ValueT> &m) { return type(m); }
+};
+
+template<typename T>
+struct ToExpr<T, typename std::enable_if<std::is_base_of<MatrixExprBase, T>::value>::type>
+{
+	static const bool is_operand = true;
+	static const bool is_matrix = true;
+	typedef T type;
+	static const T &make(const T &e) { return e; }
+};
+
+template<typename T>
+struct ToExpr<T, typename std::enable_if<std::is_arithmetic<T>::value>::type>
+{
+	static const bool is_operand = true;
+	static const bool is_matrix = false;
+	typedef ScalarTerminal<T> type;
+	static type make(T v) { return type(v); }
+};
+
+// Result of operation, 'type' is defined only if all operands are
+// matrices, expressions or scalars and at least one of them is not a scalar
+template<bool Enable, typename L, typename R, typename Op>
+struct BinaryResultImpl
+{
+};
+
+template<typename L, typename R, typename Op>
+struct BinaryResultImpl<true, L, R, Op>
+{
+	typedef BinaryExpr<typename ToExpr<L>::type, typename ToExpr<R>::type, Op> type;
+};
+
+template<typename L, typename R, typename Op>
+struct BinaryResult : BinaryResultImpl<ToExpr<L>::is_operand && ToExpr<R>::is_operand &&
+	(ToExpr<L>::is_matrix || ToExpr<R>::is_matrix), L, R, Op>
+{
+};
+
+template<bool Enable, typename T, typename Op>
+struct UnaryResultImpl
+{
+};
+
+template<typename T, typename Op>
+struct UnaryResultImpl<true, T, Op>
+{
+	typedef UnaryExpr<typename ToExpr<T>::type, Op> type;
+};
+
+template<typename T, typename Op>
+struct UnaryResult : UnaryResultImpl<ToExpr<T>::is_matrix, T, Op>
+{
+};
+
+template<typename L, typename R>
+typename BinaryResult<L, R, ExprAdd>::type operator + (const L &l, const R &r)
+{
+	return typename BinaryResult<L, R, ExprAdd>::type(ToExpr<L>::make(l), ToExpr<R>::make(r), ExprAdd());
+}
+
+template<typename L, typename R>
+typename BinaryResult<L, R, ExprSub>::type operator - (const L &l, const R &r)
+{
+	return typename BinaryResult<L, R, ExprSub>::type(ToExpr<L>::make(l), ToExpr<R>::make(r), ExprSub());
+}
+
+template<typename L, typename R>
+typename BinaryResult<L, R, ExprMul>::type operator * (const L &l, const R &r)
+{
+	return typename BinaryResult<L, R, ExprMul>::type(ToExpr<L>::make(l), ToExpr<R>::make(r), ExprMul());
+}
+
+template<typename L, typename R>
+typename BinaryResult<L, R, ExprDiv>::type operator / (const L &l, const R &r)
+{
+	return typename BinaryResult<L, R, ExprDiv>::type(ToExpr<L>::make(l), ToExpr<R>::make(r), ExprDiv());
+}
+
+template<typename T>
+typename UnaryResult<T, ExprNeg>::type operator - (const T &a)
+{
+	return typename UnaryResult<T, ExprNeg>::type(ToExpr<T>::make(a), ExprNeg());
+}
+
+template<typename T>
+typename UnaryResult<T, ExprSqrt>::type sqrt(const T &a)
+{
+	return typename UnaryResult<T, ExprSqrt>::type(ToExpr<T>::make(a), ExprSqrt());
+}
+
+// atan2(y, x) elementwise, same argument order as std::atan2
+template<typename Y, typename X>
+typename BinaryResult<Y, X, ExprAtan2>::type atan2(const Y &y, const X &x)
+{
+	return typename BinaryResult<Y, X, ExprAtan2>::type(ToExpr<Y>::make(y), ToExpr<X>::make(x), ExprAtan2());
+}
+
+// Elements less than low become low, greater than high become high
+template<typename T, typename ValueT>
+typename UnaryResult<T, ExprClamp<ValueT> >::type clamp(const T &a, ValueT low, ValueT high)
+{
+	return typename UnaryResult<T, ExprClamp<ValueT> >::type(ToExpr<T>::make(a), ExprClamp<ValueT>(low, high));
+}
+
+// static_cast of every element, e.g. cast<double>(image)
+template<typename To, typename T>
+typename UnaryResult<T, ExprCast<To> >::type cast(const T &a)
+{
+	return typename UnaryResult<T, ExprCast<To> >::type(ToExpr<T>::make(a), ExprCast<To>());
+}
+
+// Evaluation of expression, see Matrix(const MatrixExpr<Expr>&)
+template<typename ValueT>
+template<typename Expr>
+Matrix<ValueT>::Matrix(const MatrixExpr<Expr> &expr) :
+	Matrix(expr.self().rows(), expr.self().cols())
+{
+	const Expr &e = expr.self();
+	for (uint i = 0; i < n_rows; ++i) {
+		const typename Expr::row_type src = e.row(i);
+		ValueT *dst = row(i);
+		for (uint j = 0; j < n_cols; ++j)
+			dst[j] = static_cast<ValueT>(src[j]);
+	}
+}
+
+template<typename ValueT>
+template<typename Expr>
+const Matrix<ValueT> &Matrix<ValueT>::operator = (const MatrixExpr<Expr> &expr)
+{
+	// expression may refer to this matrix, so evaluate it to new storage
+	return *this = Matrix<ValueT>(expr);
+}
+
+// Evaluation into an existing matrix. Its storage is reused if the size
+// matches, so buffers can be kept from call to call (e.g. per thread).
+// The expression must not refer to dst.
+template<typename ValueT, typename Expr>
+void evaluate(const MatrixExpr<Expr> &expr, Matrix<ValueT> *dst)
+{
+	const Expr &e = expr.self();
+	if (dst->n_rows != e.rows() || dst->n_cols != e.cols())
+		*dst = Matrix<ValueT>(e.rows(), e.cols());
+	for (uint i = 0; i < dst->n_rows; ++i) {
+		const typename Expr::row_type src = e.row(i);
+		ValueT *out = dst->row(i);
+		for (uint j = 0; j < dst->n_cols; ++j)
+			out[j] = static_cast<ValueT>(src[j]);
+	}
+}
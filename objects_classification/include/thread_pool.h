@@ -0,0 +1,54 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Runs independent tasks 0..n-1 on several threads with work stealing.
+// Every thread starts with its own contiguous range of tasks and takes
+// them from the front; a thread which has run out of work steals the back
+// half of the largest range left to another thread. So neighbour tasks
+// mostly run on the same thread, and slow tasks don't leave threads idle.
+class TWorkStealingPool {
+ public:
+    explicit TWorkStealingPool(size_t threads);
+
+        // Calls body(task, worker) for every task in [0, tasks), 'worker' is
+        // the number of the thread in [0, Threads()), use it to pick per-thread
+        // scratch data. The calling thread works too, as worker 0.
+        // Returns when all tasks are done. If some task throws, the rest of
+        // tasks are skipped and the exception is rethrown here.
+    void Run(size_t tasks, const std::function<void(size_t task, size_t worker)>& body);
+
+    size_t Threads() const {
+        return threads_;
+    }
+
+        // Number of hardware threads, at least 1
+    static size_t DefaultThreads();
+
+ private:
+        // Tasks [begin, end) not taken yet by one worker
+    struct TRange {
+        size_t begin;
+        size_t end;
+        std::mutex mutex;
+
+        TRange(): begin(0), end(0), mutex() {}
+    };
+
+        // Takes next task of 'worker', stealing if needed.
+        // Returns false when no tasks are left anywhere.
+    bool Take(size_t worker, size_t* task);
+    void Work(size_t worker, const std::function<void(size_t, size_t)>& body);
+
+    size_t threads_;
+    std::vector<TRange> ranges_;
+        // Set when some task has thrown
+    bool failed_;
+    std::mutex failure_mutex_;
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "allocator.h"
+
+#include <atomic>
+#include <cstdlib>
+
+using std::map;
+using std::vector;
+using std::mutex;
+using std::lock_guard;
+
+// Round size up to the whole number of cache lines
+static size_t round_up(size_t bytes)
+{
+    const size_t line = MatrixAllocator::CACHE_LINE;
+    return (bytes + line - 1) / line * line;
+}
+
+static void *aligned_malloc(size_t bytes)
+{
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, MatrixAllocator::CACHE_LINE, round_up(bytes ? bytes : 1)))
+        throw std::bad_alloc();
+    return ptr;
+}
+
+// Current default allocator. Matrices are created on worker threads,
+// so it is atomic and initialized once (thread-safe local static)
+static std::atomic<MatrixAllocator *> &default_allocator()
+{
+    static std::atomic<MatrixAllocator *> allocator(&pool_allocator());
+    return allocator;
+}
+
+MatrixAllocator::~MatrixAllocator()
+{}
+
+MatrixAllocator *MatrixAllocator::get_default()
+{
+    return default_allocator().load();
+}
+
+void MatrixAllocator::set_default(MatrixAllocator *allocator)
+{
+    default_allocator().store(allocator);
+}
+
+void *HeapAllocator::allocate(size_t bytes)
+{
+    return aligned_malloc(bytes);
+}
+
+void HeapAllocator::deallocate(void *ptr, size_t)
+{
+    free(ptr);
+}
+
+PoolAllocator::PoolAllocator(size_t max_cached_bytes):
+    max_cached{max_cached_bytes},
+    cached{0},
+    free_blocks{},
+    lock{}
+{}
+
+PoolAllocator::~PoolAllocator()
+{
+    release();
+}
+
+void *PoolAllocator::allocate(size_t bytes)
+{
+    size_t key = round_up(bytes);
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = free_blocks.find(key);
+        if (it != free_blocks.end() && !it->second.empty()) {
+            void *ptr = it->second.back();
+            it->second.pop_back();
+            cached -= key;
+            return ptr;
+        }
+    }
+    return aligned_malloc(key);
+}
+
+void PoolAllocator::deallocate(void *ptr, size_t bytes)
+{
+    size_t key = round_up(bytes);
+    {
+        lock_guard<mutex> guard(lock);
+        if (cached + key <= max_cached) {
+            free_blocks[key].push_back(ptr);
+            cached += key;
+            return;
+        }
+    }
+    free(ptr);
+}
+
+void PoolAllocator::release()
+{
+    lock_guard<mutex> guard(lock);
+    for (auto &blocks : free_blocks)
+        for (void *ptr : blocks.second)
+            free(ptr);
+    free_blocks.clear();
+    cached = 0;
+}
+
+size_t PoolAllocator::cached_bytes() const
+{
+    lock_guard<mutex> guard(lock);
+    return cached;
+}
+
+HeapAllocator &heap_allocator()
+{
+    static HeapAllocator *heap = new HeapAllocator();
+    return *heap;
+}
+
+PoolAllocator &pool_allocator()
+{
+    static PoolAllocator *pool = new PoolAllocator();
+    return *pool;
+}
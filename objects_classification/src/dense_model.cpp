@@ -0,0 +1,175 @@
+#include "dense_model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using std::string;
+using std::vector;
+
+// Block of the product: ROW_BLOCK samples times FEATURE_BLOCK features.
+// Features of the block rows (16 KB) and weights of all functions for
+// these features stay in cache while all functions are computed.
+static const size_t ROW_BLOCK = 4;
+static const size_t FEATURE_BLOCK = 1024;
+
+// Unit roundoff of float32
+static const double FLOAT_ROUNDOFF = std::ldexp(1.0, -24);
+
+// Longest chain of additions one product of a block goes through inside
+// AddDotProducts: its SIMD lane (or the scalar sum), the tail and the lanes
+#ifdef __SSE2__
+static const size_t BLOCK_CHAIN = FEATURE_BLOCK / 4 + 3 + 2;
+#else
+static const size_t BLOCK_CHAIN = FEATURE_BLOCK;
+#endif
+
+// Dot products of 'count' (at most ROW_BLOCK) rows with 'w' over
+// features [begin, end), added to sums[r * step]
+static void AddDotProducts(const float* const* rows, size_t count, const float* w,
+                           size_t begin, size_t end, float* sums, size_t step) {
+    size_t f = begin;
+    float lanes[ROW_BLOCK][4] = {};
+#ifdef __SSE2__
+    __m128 acc[ROW_BLOCK];
+    for (size_t r = 0; r < ROW_BLOCK; ++r)
+        acc[r] = _mm_setzero_ps();
+    for (; f + 4 <= end; f += 4) {
+        __m128 weights = _mm_loadu_ps(w + f);
+        for (size_t r = 0; r < count; ++r)
+            acc[r] = _mm_add_ps(acc[r], _mm_mul_ps(_mm_loadu_ps(rows[r] + f), weights));
+    }
+    for (size_t r = 0; r < count; ++r)
+        _mm_storeu_ps(lanes[r], acc[r]);
+#endif
+    for (; f < end; ++f)
+        for (size_t r = 0; r < count; ++r)
+            lanes[r][0] += rows[r][f] * w[f];
+    for (size_t r = 0; r < count; ++r)
+        sums[r * step] += (lanes[r][0] + lanes[r][1]) + (lanes[r][2] + lanes[r][3]);
+}
+
+TDenseModel::TDenseModel(const struct model* model):
+    model_(model), dim_(0), functions_(0), weights_(), bias_(), norms_(), labels_() {
+    if (!model)
+        throw string("Model is not loaded");
+    dim_ = model->nr_feature;
+    bool one = model->nr_class == 2 && model->param.solver_type != MCSVM_CS;
+    functions_ = one ? 1 : model->nr_class;
+
+        // liblinear keeps weight of feature f for function k in w[f * functions + k]
+    weights_.resize(functions_ * dim_);
+    norms_.assign(functions_, 0.0f);
+    for (size_t k = 0; k < functions_; ++k) {
+        double norm = 0;
+        for (size_t f = 0; f < dim_; ++f) {
+            weights_[k * dim_ + f] = model->w[f * functions_ + k];
+            norm += model->w[f * functions_ + k] * model->w[f * functions_ + k];
+        }
+        norms_[k] = std::sqrt(norm);
+    }
+    bias_.assign(functions_, 0.0f);
+    if (model->bias >= 0)
+        for (size_t k = 0; k < functions_; ++k)
+            bias_[k] = model->w[dim_ * functions_ + k] * model->bias;
+    labels_.assign(model->label, model->label + model->nr_class);
+}
+
+int TDenseModel::Label(const float* values, float* score) const {
+    if (functions_ == 1) {
+        *score = values[0] > 0 ? values[0] : -values[0];
+        return values[0] > 0 ? labels_[0] : labels_[1];
+    }
+        // the first of equal maximums, as in liblinear
+    size_t best = std::max_element(values, values + functions_) - values;
+    *score = values[best];
+    return labels_[best];
+}
+
+void TDenseModel::DecisionValues(const TFeatures& features, size_t first, size_t count,
+                                 float* values, float* bounds) const {
+        // testing samples may have more features than the model, extra ones are ignored
+    size_t dim = std::min(features.Dim(), dim_);
+    const float* rows[ROW_BLOCK];
+    float squares[ROW_BLOCK] = {};
+    for (size_t r = 0; r < count; ++r)
+        rows[r] = features.Row(first + r);
+    for (size_t r = 0; r < count; ++r)
+        for (size_t k = 0; k < functions_; ++k)
+            values[r * functions_ + k] = 0;
+
+    for (size_t begin = 0; begin < dim; begin += FEATURE_BLOCK) {
+        size_t end = std::min(begin + FEATURE_BLOCK, dim);
+        for (size_t r = 0; r < count; ++r)
+            AddDotProducts(rows + r, 1, rows[r], begin, end, squares + r, 1);
+        for (size_t k = 0; k < functions_; ++k)
+            AddDotProducts(rows, count, Weights(k), begin, end, values + k, functions_);
+    }
+
+        // A sum of products in which every product goes through at most h
+        // roundings errs by at most h * u / (1 - h * u) * sum |x_f * w_f|,
+        // which is not more than that times |x| * |w| (u is the unit roundoff).
+        // Here h is the chain of a block, the sum over blocks, the product,
+        // the bias and the weights rounded to float; the norms themselves
+        // are rounded too, so the bound is doubled
+    size_t blocks = (dim + FEATURE_BLOCK - 1) / FEATURE_BLOCK;
+    double chain = double(BLOCK_CHAIN + blocks + 3) * FLOAT_ROUNDOFF;
+    double gamma = 2 * chain / (1 - chain);
+    for (size_t r = 0; r < count; ++r) {
+        for (size_t k = 0; k < functions_; ++k) {
+            float bias = bias_[k];
+            values[r * functions_ + k] += bias;
+            bounds[r * functions_ + k] = gamma * (std::sqrt(squares[r]) * norms_[k] +
+                                                  std::fabs(bias));
+        }
+    }
+}
+
+int TDenseModel::ExactLabel(const float* row, size_t features_dim) const {
+    vector<struct feature_node> x(features_dim + 2);
+    for (size_t f = 0; f < features_dim; ++f) {
+        x[f].index = f + 1;
+        x[f].value = row[f];
+    }
+    size_t end = features_dim;
+    if (model_->bias >= 0) {
+        x[end].index = model_->nr_feature + 1;
+        x[end].value = model_->bias;
+        ++end;
+    }
+    x[end].index = -1;
+    return predict(model_, x.data());
+}
+
+void TDenseModel::Predict(const TFeatures& features, vector<int>* labels) const {
+    bool regression = model_->param.solver_type == L2R_L2LOSS_SVR ||
+                      model_->param.solver_type == L2R_L1LOSS_SVR_DUAL ||
+                      model_->param.solver_type == L2R_L2LOSS_SVR_DUAL;
+    vector<float> values(ROW_BLOCK * functions_), bounds(ROW_BLOCK * functions_);
+    for (size_t first = 0; first < features.Samples(); first += ROW_BLOCK) {
+        size_t count = std::min(ROW_BLOCK, features.Samples() - first);
+        if (!regression)
+            DecisionValues(features, first, count, values.data(), bounds.data());
+        for (size_t r = 0; r < count; ++r) {
+            const float* value = values.data() + r * functions_;
+            const float* bound = bounds.data() + r * functions_;
+                // regression values aren't labels, leave them to liblinear
+            bool tie = regression;
+            if (!regression && functions_ == 1) {
+                tie = std::fabs(value[0]) <= bound[0];
+            } else if (!regression) {
+                size_t best = std::max_element(value, value + functions_) - value;
+                for (size_t k = 0; k < functions_; ++k)
+                    if (k != best && value[best] - value[k] <= bound[best] + bound[k])
+                        tie = true;
+            }
+            float score;
+            labels->push_back(tie ? ExactLabel(features.Row(first + r), features.Dim())
+                                  : Label(value, &score));
+        }
+    }
+}
@@ -0,0 +1,188 @@
+#include "feature_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::string;
+using std::shared_ptr;
+using std::lock_guard;
+using std::mutex;
+
+static const char CACHE_MAGIC[4] = {'F', 'C', 'H', '1'};
+static const uint32_t CACHE_LAYOUT_VERSION = 2;
+static const size_t CACHE_HEADER_SIZE = 32;
+    // Path length, mtime and size
+static const size_t KEY_SIZE = 3 * sizeof(uint64_t);
+
+    // Path bytes with padding, so that descriptors stay 8-byte aligned
+static size_t PaddedLength(size_t path_length) {
+    return (path_length + 7) / 8 * 8;
+}
+
+TFeatureCache::TFeatureCache(const string& path, size_t dim, uint64_t config):
+    path_(path),
+    dim_(dim),
+    config_(config),
+    mapping_(),
+    index_(),
+    mutex_(),
+    new_keys_(),
+    new_values_()
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || size_t(st.st_size) < CACHE_HEADER_SIZE) {
+        close(fd);
+        return;
+    }
+    size_t file_size = st.st_size;
+    void* ptr = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return;
+    mapping_ = shared_ptr<unsigned char>(static_cast<unsigned char*>(ptr),
+        [file_size](unsigned char* p) { munmap(p, file_size); });
+
+    const unsigned char* header = mapping_.get();
+    uint32_t version, file_dim, count;
+    uint64_t file_config;
+    memcpy(&version, header + 4, sizeof(version));
+    memcpy(&file_config, header + 8, sizeof(file_config));
+    memcpy(&file_dim, header + 16, sizeof(file_dim));
+    memcpy(&count, header + 20, sizeof(count));
+
+    bool valid = !memcmp(header, CACHE_MAGIC, sizeof(CACHE_MAGIC)) &&
+        version == CACHE_LAYOUT_VERSION && file_config == config_ && file_dim == dim_;
+    size_t offset = CACHE_HEADER_SIZE;
+    for (size_t record = 0; valid && record < count; ++record) {
+        uint64_t path_length;
+        valid = offset + KEY_SIZE <= file_size;
+        if (valid) {
+            memcpy(&path_length, header + offset, sizeof(path_length));
+            valid = path_length <= file_size &&
+                offset + RecordSize(path_length) <= file_size;
+        }
+        if (valid) {
+            const char* path_bytes = reinterpret_cast<const char*>(header + offset + KEY_SIZE);
+            index_[string(path_bytes, path_length)] = offset;
+            offset += RecordSize(path_length);
+        }
+    }
+    if (!valid) {
+            // Stale cache, it will be overwritten by Save()
+        index_.clear();
+        mapping_.reset();
+    }
+}
+
+size_t TFeatureCache::RecordSize(size_t path_length) const {
+    return KEY_SIZE + PaddedLength(path_length) + dim_ * sizeof(float);
+}
+
+bool TFeatureCache::MakeKey(const string& image_path, TKey* key) {
+    struct stat st;
+    if (stat(image_path.c_str(), &st) < 0)
+        return false;
+    key->path = image_path;
+    key->mtime = uint64_t(st.st_mtim.tv_sec) * 1000000000ULL + st.st_mtim.tv_nsec;
+    key->size = st.st_size;
+    return true;
+}
+
+const float* TFeatureCache::Find(const TKey& key) const {
+        // the index is keyed by the stored path itself, so only
+        // the record of this very path is found
+    auto found = index_.find(key.path);
+    if (found == index_.end())
+        return NULL;
+    const unsigned char* record = mapping_.get() + found->second;
+    uint64_t mtime, size;
+    memcpy(&mtime, record + sizeof(uint64_t), sizeof(mtime));
+    memcpy(&size, record + 2 * sizeof(uint64_t), sizeof(size));
+    if (mtime != key.mtime || size != key.size)
+        return NULL;
+    return reinterpret_cast<const float*>(record + KEY_SIZE + PaddedLength(key.path.size()));
+}
+
+bool TFeatureCache::Lookup(const string& image_path, float* desc) const {
+    TKey key;
+    if (!MakeKey(image_path, &key))
+        return false;
+    const float* cached = Find(key);
+    if (!cached)
+        return false;
+    memcpy(desc, cached, dim_ * sizeof(float));
+    return true;
+}
+
+void TFeatureCache::Store(const string& image_path, const float* desc) {
+    TKey key;
+    if (!MakeKey(image_path, &key))
+        return;
+    lock_guard<mutex> lock(mutex_);
+    new_keys_.push_back(key);
+    new_values_.insert(new_values_.end(), desc, desc + dim_);
+}
+
+void TFeatureCache::Save() {
+    lock_guard<mutex> lock(mutex_);
+    if (new_keys_.empty())
+        return;
+
+        // New records replace old ones of the same path
+    std::unordered_map<string, size_t> fresh;
+    for (size_t idx = 0; idx < new_keys_.size(); ++idx)
+        fresh[new_keys_[idx].path] = idx;
+
+        // Offsets and sizes of old records which are kept
+    std::vector<std::pair<size_t, size_t> > kept;
+    for (auto it = index_.begin(); it != index_.end(); ++it)
+        if (!fresh.count(it->first))
+            kept.push_back(std::make_pair(it->second, RecordSize(it->first.size())));
+
+        // Written to a temporary file first: the old one is still mapped
+    string tmp_path = path_ + ".tmp";
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    if (!file) {
+        perror(tmp_path.c_str());
+        return;
+    }
+
+    unsigned char header[CACHE_HEADER_SIZE] = {};
+    uint32_t version = CACHE_LAYOUT_VERSION, dim = dim_;
+    uint32_t count = kept.size() + fresh.size();
+    memcpy(header, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    memcpy(header + 4, &version, sizeof(version));
+    memcpy(header + 8, &config_, sizeof(config_));
+    memcpy(header + 16, &dim, sizeof(dim));
+    memcpy(header + 20, &count, sizeof(count));
+    bool ok = fwrite(header, CACHE_HEADER_SIZE, 1, file) == 1;
+
+    for (size_t idx = 0; idx < kept.size() && ok; ++idx) {
+        const unsigned char* record = mapping_.get() + kept[idx].first;
+        ok = fwrite(record, kept[idx].second, 1, file) == 1;
+    }
+    for (auto it = fresh.begin(); it != fresh.end() && ok; ++it) {
+        const TKey& key = new_keys_[it->second];
+        uint64_t fields[3] = {key.path.size(), key.mtime, key.size};
+        std::vector<char> path_bytes(PaddedLength(key.path.size()), 0);
+        std::copy(key.path.begin(), key.path.end(), path_bytes.begin());
+        ok = fwrite(fields, KEY_SIZE, 1, file) == 1 &&
+            fwrite(path_bytes.data(), 1, path_bytes.size(), file) == path_bytes.size() &&
+            fwrite(&new_values_[it->second * dim_], sizeof(float), dim_, file) == dim_;
+    }
+
+    if (fclose(file) != 0 || !ok || rename(tmp_path.c_str(), path_.c_str()) != 0) {
+        perror(path_.c_str());
+        remove(tmp_path.c_str());
+    }
+}
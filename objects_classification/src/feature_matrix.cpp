@@ -0,0 +1,97 @@
+#include "feature_matrix.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+using std::shared_ptr;
+
+static const char MATRIX_MAGIC[4] = {'F', 'M', 'A', 'T'};
+static const uint32_t MATRIX_FORMAT_VERSION = 1;
+static const size_t MATRIX_HEADER_SIZE = 32;
+
+void SaveFeatures(const TFeatures& features, uint64_t config, const string& path) {
+    TFeatureFileInfo info;
+    info.version = MATRIX_FORMAT_VERSION;
+    info.config = config;
+    info.rows = features.Samples();
+    info.cols = features.Dim() + 1;
+    info.label_column = features.Dim();
+
+    unsigned char header[MATRIX_HEADER_SIZE] = {};
+    memcpy(header, MATRIX_MAGIC, sizeof(MATRIX_MAGIC));
+    memcpy(header + 4, &info.version, sizeof(info.version));
+    memcpy(header + 8, &info.config, sizeof(info.config));
+    memcpy(header + 16, &info.rows, sizeof(info.rows));
+    memcpy(header + 24, &info.cols, sizeof(info.cols));
+    memcpy(header + 28, &info.label_column, sizeof(info.label_column));
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+        throw string("Error writing file ") + path;
+    bool ok = fwrite(header, MATRIX_HEADER_SIZE, 1, file) == 1;
+
+    vector<float> row(info.cols);
+    for (size_t idx = 0; idx < features.Samples() && ok; ++idx) {
+        memcpy(row.data(), features.Row(idx), features.Dim() * sizeof(float));
+        row[info.label_column] = features.Label(idx);
+        ok = fwrite(row.data(), sizeof(float), row.size(), file) == row.size();
+    }
+
+    if (fclose(file) != 0 || !ok)
+        throw string("Error writing file ") + path;
+}
+
+TFeatures MapFeatures(const string& path, TFeatureFileInfo* info) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw string("Error reading file ") + path;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || size_t(st.st_size) < MATRIX_HEADER_SIZE) {
+        close(fd);
+        throw string("Not a feature matrix file ") + path;
+    }
+    size_t file_size = st.st_size;
+    void* ptr = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        // the mapping stays valid after the descriptor is closed
+    close(fd);
+    if (ptr == MAP_FAILED)
+        throw string("Error reading file ") + path;
+    shared_ptr<unsigned char> mapping(static_cast<unsigned char*>(ptr),
+        [file_size](unsigned char* p) { munmap(p, file_size); });
+
+    const unsigned char* header = mapping.get();
+    TFeatureFileInfo file_info;
+    memcpy(&file_info.version, header + 4, sizeof(file_info.version));
+    memcpy(&file_info.config, header + 8, sizeof(file_info.config));
+    memcpy(&file_info.rows, header + 16, sizeof(file_info.rows));
+    memcpy(&file_info.cols, header + 24, sizeof(file_info.cols));
+    memcpy(&file_info.label_column, header + 28, sizeof(file_info.label_column));
+
+    if (memcmp(header, MATRIX_MAGIC, sizeof(MATRIX_MAGIC)))
+        throw string("Not a feature matrix file ") + path;
+    if (file_info.version != MATRIX_FORMAT_VERSION)
+        throw string("Unsupported feature matrix version in ") + path;
+        // features must be contiguous, so the label is the first or the last column
+    if (file_info.cols < 2 ||
+        (file_info.label_column != 0 && file_info.label_column != file_info.cols - 1) ||
+        MATRIX_HEADER_SIZE + file_info.rows * file_info.cols * sizeof(float) > file_size)
+        throw string("Broken feature matrix file ") + path;
+
+    float* values = reinterpret_cast<float*>(mapping.get() + MATRIX_HEADER_SIZE);
+    vector<int> labels(file_info.rows);
+    for (size_t idx = 0; idx < labels.size(); ++idx)
+        labels[idx] = static_cast<int>(values[idx * file_info.cols + file_info.label_column]);
+
+    if (info)
+        *info = file_info;
+    float* first_row = values + (file_info.label_column == 0 ? 1 : 0);
+    return TFeatures(shared_ptr<float>(mapping, first_row), file_info.cols - 1,
+                     file_info.cols, labels);
+}
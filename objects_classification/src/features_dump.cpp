@@ -0,0 +1,49 @@
+// Prints header of a feature matrix file (see feature_matrix.h) and,
+// optionally, its first rows in liblinear text format:
+//   label 1:value 2:value ...
+// Usage: features_dump <file> [rows]
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "feature_matrix.h"
+
+using std::string;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+int main(int argc, char** argv) {
+    if (argc != 2 && argc != 3) {
+        cerr << "Usage: " << argv[0] << " <feature matrix file> [rows to print]" << endl;
+        return 1;
+    }
+
+    try {
+        TFeatureFileInfo info;
+        TFeatures features = MapFeatures(argv[1], &info);
+
+        cout << "version: " << info.version << endl;
+        cout << "features config: 0x" << std::hex << info.config << std::dec << endl;
+        cout << "rows: " << info.rows << endl;
+        cout << "cols: " << info.cols << endl;
+        cout << "label column: " << info.label_column << endl;
+
+        size_t rows = argc == 3 ? strtoul(argv[2], NULL, 10) : 0;
+        if (rows > features.Samples())
+            rows = features.Samples();
+        for (size_t idx = 0; idx < rows; ++idx) {
+            const float* row = features.Row(idx);
+            cout << features.Label(idx);
+                // zeros are omitted, as in sparse liblinear input
+            for (size_t col = 0; col < features.Dim(); ++col)
+                if (row[col] < 0.0f || row[col] > 0.0f)
+                    cout << ' ' << col + 1 << ':' << row[col];
+            cout << '\n';
+        }
+    } catch (const string& error) {
+        cerr << "Error! " << error << endl;
+        return 1;
+    }
+}
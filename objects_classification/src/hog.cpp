@@ -0,0 +1,225 @@
+#include "hog.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using std::vector;
+
+static const float PI = 3.14159265358979f;
+// L2-Hys: values are clipped to this after the first normalisation
+static const float HYS_CLIP = 0.2f;
+// Keeps normalisation of empty blocks finite
+static const float NORM_EPS = 1e-3f;
+
+// Coefficients of atan(t) ~ t * P(t^2) on [0, 1], error below 1e-5,
+// plenty for interpolation weights
+static const float ATAN_COEFFS[6] = {
+    0.99997726f, -0.33262347f, 0.19354346f, -0.11643287f, 0.05265332f, -0.01172120f
+};
+
+// Unsigned orientation of vector (x, y) in [0, pi). No branches, only
+// selects, the same steps as the SSE2 version in GradientRow().
+static float UnsignedOrientation(float x, float y) {
+    float sign = y < 0 ? -1.0f : 1.0f;
+    x *= sign;
+    y *= sign;
+    float ax = std::fabs(x);
+    float small = std::min(ax, y), large = std::max(std::max(ax, y), FLT_MIN);
+    float t = small / large, t2 = t * t;
+    float poly = ATAN_COEFFS[5];
+    for (int k = 4; k >= 0; --k)
+        poly = poly * t2 + ATAN_COEFFS[k];
+    float angle = t * poly;
+    angle = y > ax ? PI / 2 - angle : angle;
+    angle = x < 0 ? PI - angle : angle;
+    return angle < PI ? angle : 0;
+}
+
+THogEngine::THogEngine(size_t bins):
+    bins_(bins),
+    grid_rows_(0),
+    grid_cols_(0),
+    cells_(),
+    votes_(),
+    row_weights_(),
+    col_weights_(),
+    magnitude_(),
+    first_bin_(),
+    upper_(),
+    row_votes_()
+{}
+
+size_t THogEngine::DescriptorSize(size_t rows, size_t cols) const {
+    if (rows < 2 || cols < 2)
+        return 0;
+    return (rows - 1) * (cols - 1) * 4 * bins_;
+}
+
+void THogEngine::AxisWeights(size_t pixels, float cell_size, size_t cells,
+                             vector<TAxisWeight>* weights) {
+    weights->resize(pixels);
+    for (size_t pixel = 0; pixel < pixels; ++pixel) {
+        TAxisWeight& weight = (*weights)[pixel];
+            // Position of pixel center in cells, relative to the first cell center
+        float pos = (pixel + 0.5f) / cell_size - 0.5f;
+        float first = std::floor(pos);
+        weight.far = pos - first;
+        weight.near = 1 - weight.far;
+        weight.first = static_cast<int>(first);
+        if (weight.first < 0) {
+                // before the first cell center: all to the first cell
+            weight.first = 0;
+            weight.near = 1;
+            weight.far = 0;
+        } else if (weight.first >= static_cast<int>(cells) - 1) {
+                // after the last cell center: all to the last cell,
+                // nothing if the pixel is out of the grid
+            weight.near = weight.first == static_cast<int>(cells) - 1 &&
+                          pixel + 0.5f <= cells * cell_size ? 1 : 0;
+            weight.first = cells - 1;
+            weight.far = 0;
+        }
+    }
+}
+
+void THogEngine::GradientRow(const float* prev, const float* cur, const float* next, size_t cols) {
+    float bins_per_radian = bins_ / PI;
+    size_t j = 0;
+#ifdef __SSE2__
+    const __m128 sign_bit = _mm_set1_ps(-0.0f), zeros = _mm_setzero_ps();
+    const __m128 pi = _mm_set1_ps(PI), half_pi = _mm_set1_ps(PI / 2);
+    const __m128 scale = _mm_set1_ps(bins_per_radian), half = _mm_set1_ps(0.5f);
+    const __m128i last_bin = _mm_set1_epi32(static_cast<int>(bins_) - 1);
+    for (; j + 4 <= cols; j += 4) {
+        __m128 x = _mm_sub_ps(_mm_loadu_ps(cur + j + 2), _mm_loadu_ps(cur + j));
+        __m128 y = _mm_sub_ps(_mm_loadu_ps(prev + j + 1), _mm_loadu_ps(next + j + 1));
+        _mm_storeu_ps(&magnitude_[j], _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y))));
+
+            // turn to the upper half plane
+        __m128 flip = _mm_and_ps(_mm_cmplt_ps(y, zeros), sign_bit);
+        x = _mm_xor_ps(x, flip);
+        y = _mm_xor_ps(y, flip);
+        __m128 ax = _mm_andnot_ps(sign_bit, x);
+        __m128 small = _mm_min_ps(ax, y);
+        __m128 large = _mm_max_ps(_mm_max_ps(ax, y), _mm_set1_ps(FLT_MIN));
+        __m128 t = _mm_div_ps(small, large), t2 = _mm_mul_ps(t, t);
+        __m128 poly = _mm_set1_ps(ATAN_COEFFS[5]);
+        for (int k = 4; k >= 0; --k)
+            poly = _mm_add_ps(_mm_mul_ps(poly, t2), _mm_set1_ps(ATAN_COEFFS[k]));
+        __m128 angle = _mm_mul_ps(t, poly);
+        __m128 steep = _mm_cmpgt_ps(y, ax);
+        angle = _mm_or_ps(_mm_and_ps(steep, _mm_sub_ps(half_pi, angle)), _mm_andnot_ps(steep, angle));
+        __m128 left = _mm_cmplt_ps(x, zeros);
+        angle = _mm_or_ps(_mm_and_ps(left, _mm_sub_ps(pi, angle)), _mm_andnot_ps(left, angle));
+        angle = _mm_and_ps(angle, _mm_cmplt_ps(angle, pi));
+
+            // orientation in bins relative to the first bin center is at least
+            // -0.5, so truncation of (orientation + 1) is floor + 1
+        __m128 orientation = _mm_sub_ps(_mm_mul_ps(angle, scale), half);
+        __m128i bin = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(orientation, _mm_set1_ps(1.0f))),
+                                    _mm_set1_epi32(1));
+        _mm_storeu_ps(&upper_[j], _mm_sub_ps(orientation, _mm_cvtepi32_ps(bin)));
+            // bin -1 is the last one
+        __m128i before = _mm_cmplt_epi32(bin, _mm_setzero_si128());
+        bin = _mm_or_si128(_mm_and_si128(before, last_bin), _mm_andnot_si128(before, bin));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&first_bin_[j]), bin);
+    }
+#endif
+    for (; j < cols; ++j) {
+        float x = cur[j + 2] - cur[j];
+        float y = prev[j + 1] - next[j + 1];
+        magnitude_[j] = std::sqrt(x * x + y * y);
+        float orientation = UnsignedOrientation(x, y) * bins_per_radian - 0.5f;
+        float bin = std::floor(orientation);
+        upper_[j] = orientation - bin;
+        first_bin_[j] = bin < 0 ? bins_ - 1 : static_cast<int>(bin);
+    }
+}
+
+void THogEngine::ComputeCells(const Matrix<float>& gray, float cell_h, float cell_w,
+                              size_t grid_rows, size_t grid_cols) {
+    size_t rows = gray.n_rows - 2, cols = gray.n_cols - 2;
+    grid_rows_ = grid_rows;
+    grid_cols_ = grid_cols;
+    size_t stride = grid_cols + 1;
+    votes_.assign((grid_rows + 1) * stride * bins_, 0.0f);
+    AxisWeights(rows, cell_h, grid_rows, &row_weights_);
+    AxisWeights(cols, cell_w, grid_cols, &col_weights_);
+    magnitude_.resize(cols);
+    first_bin_.resize(cols);
+    upper_.resize(cols);
+    row_votes_.resize(stride * bins_);
+
+    for (size_t i = 0; i < rows; ++i) {
+        const TAxisWeight& row_weight = row_weights_[i];
+        if (!(row_weight.near > 0) && !(row_weight.far > 0))
+            continue;
+
+        GradientRow(gray.row(i), gray.row(i + 1), gray.row(i + 2), cols);
+
+            // votes of the row interpolated along columns and orientation,
+            // then spread into two rows of cells at once
+        std::fill(row_votes_.begin(), row_votes_.end(), 0.0f);
+        for (size_t j = 0; j < cols; ++j) {
+            const TAxisWeight& col_weight = col_weights_[j];
+            float upper = upper_[j];
+            size_t first_bin = first_bin_[j];
+            size_t second_bin = first_bin + 1 == bins_ ? 0 : first_bin + 1;
+
+            float* near = row_votes_.data() + col_weight.first * bins_;
+            float* far = near + bins_;
+            float near_vote = col_weight.near * magnitude_[j], far_vote = col_weight.far * magnitude_[j];
+            near[first_bin] += near_vote * (1 - upper);
+            near[second_bin] += near_vote * upper;
+            far[first_bin] += far_vote * (1 - upper);
+            far[second_bin] += far_vote * upper;
+        }
+
+        float* near_cells = votes_.data() + row_weight.first * stride * bins_;
+        float* far_cells = near_cells + stride * bins_;
+        for (size_t idx = 0; idx < stride * bins_; ++idx) {
+            near_cells[idx] += row_weight.near * row_votes_[idx];
+            far_cells[idx] += row_weight.far * row_votes_[idx];
+        }
+    }
+
+    cells_.resize(grid_rows * grid_cols * bins_);
+    for (size_t row = 0; row < grid_rows; ++row)
+        std::copy(votes_.begin() + row * stride * bins_,
+                  votes_.begin() + (row * stride + grid_cols) * bins_,
+                  cells_.begin() + row * grid_cols * bins_);
+}
+
+// L2 normalisation, eps keeps empty blocks at zero
+static void NormalizeL2(float* values, size_t size) {
+    float sum = NORM_EPS * NORM_EPS;
+    for (size_t idx = 0; idx < size; ++idx)
+        sum += values[idx] * values[idx];
+    float norm = std::sqrt(sum);
+    for (size_t idx = 0; idx < size; ++idx)
+        values[idx] /= norm;
+}
+
+void THogEngine::Describe(size_t row, size_t col, size_t rows, size_t cols, float* desc) const {
+    size_t block_size = 4 * bins_;
+    for (size_t block_row = row; block_row + 1 < row + rows; ++block_row) {
+        for (size_t block_col = col; block_col + 1 < col + cols; ++block_col) {
+            float* block = desc;
+            for (size_t dy = 0; dy < 2; ++dy)
+                for (size_t dx = 0; dx < 2; ++dx)
+                    desc = std::copy(Cell(block_row + dy, block_col + dx),
+                                     Cell(block_row + dy, block_col + dx) + bins_, desc);
+
+                // L2-Hys
+            NormalizeL2(block, block_size);
+            for (size_t idx = 0; idx < block_size; ++idx)
+                block[idx] = std::min(block[idx], HYS_CLIP);
+            NormalizeL2(block, block_size);
+        }
+    }
+}
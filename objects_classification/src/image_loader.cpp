@@ -0,0 +1,12 @@
+#include "image_loader.h"
+
+void TImageLoader::ForEach(const std::function<void(TLoadedImage& loaded, size_t worker)>& process) {
+    pool_.Run(file_list_.size(), [this, &process](size_t task, size_t worker) {
+        TLoadedImage loaded;
+        loaded.index = task;
+        loaded.label = file_list_[task].second;
+        loaded.image.reset(new BMP());
+        loaded.image->ReadFromFile(file_list_[task].first.c_str());
+        process(loaded, worker);
+    });
+}
@@ -1,15 +1,29 @@
 #include <string>
+#include <algorithm>
 #include <vector>
 #include <fstream>
 #include <cassert>
 #include <iostream>
 #include <cmath>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "classifier.h"
+#include "dense_model.h"
+#include "feature_cache.h"
+#include "feature_matrix.h"
+#include "hog.h"
+#include "image_loader.h"
 #include "EasyBMP.h"
 #include "linear.h"
 #include "argvparser.h"
 #include "matrix.h"
+#include "matrix_expr.h"
 
 using std::string;
 using std::vector;
@@ -23,18 +37,116 @@ using std::endl;
 
 using CommandLineProcessing::ArgvParser;
 
-typedef vector<pair<BMP*, int> > TDataSet;
-typedef vector<pair<string, int> > TFileList;
-typedef vector<pair<vector<float>, int> > TFeatures;
 
 typedef Matrix<float> FImage; // "слепок" изображения; матрица для модулей и углов
-typedef Matrix<vector<float> > HistoMatrix; // матрица для гистограмм
 
 #define CELLS 5 // делим изображение CELLS x CELLS блоков
 #define SEGMENTS 20 // делим область изменения направления градиента на сегменты
 #define COLOR_CELLS 6
 #define LBP_CELLS 6
 
+// варианты гистограмм LBP
+enum TLbpMode {
+    LBP_ALL, // все 256 кодов
+    LBP_UNIFORM, // равномерные коды (не больше двух переходов 0-1 по кругу) и один общий столбец для прочих: 59
+    LBP_ROTATION_INVARIANT // равномерные коды с точностью до поворота - по числу единиц, и прочие: 10
+};
+
+// Столбцы гистограммы LBP для каждого из 256 кодов
+struct TLbpTable {
+    unsigned char bins[256];
+    uint size; // число столбцов
+
+    explicit TLbpTable(TLbpMode mode) : bins(), size(0)
+    {
+        // номера битов соседей при обходе по кругу по часовой стрелке с левого верхнего
+        // (в коде соседи идут по строкам, см. lbp_row_codes)
+        const uint circle[8] = {0, 1, 2, 4, 7, 6, 5, 3};
+        uint uniform = 0; // равномерных кодов уже встретилось
+        for (uint code = 0; code < 256; code++) {
+            uint transitions = 0, ones = 0;
+            for (uint k = 0; k < 8; k++) {
+                uint bit = code >> circle[k] & 1, next = code >> circle[(k + 1) % 8] & 1;
+                transitions += bit != next;
+                ones += bit;
+            }
+            switch (mode) {
+            case LBP_UNIFORM:
+                bins[code] = transitions <= 2 ? uniform++ : 58;
+                break;
+            case LBP_ROTATION_INVARIANT:
+                bins[code] = transitions <= 2 ? ones : 9;
+                break;
+            default:
+                bins[code] = code;
+            }
+        }
+        size = mode == LBP_ALL ? 256 : (mode == LBP_UNIFORM ? 59 : 10);
+    }
+};
+
+// длины частей дескриптора: прежний HOG, средние цвета клеток (остальное зависит от параметров)
+const uint HOG_SIZE = CELLS * CELLS * SEGMENTS;
+const uint COLOR_SIZE = COLOR_CELLS * COLOR_CELLS * 3;
+
+// версия извлечения признаков: увеличивать при любом изменении дескриптора,
+// иначе кэш признаков (см. feature_cache.h) выдаст старые значения
+#define FEATURES_VERSION 1
+// конфигурация признаков, записываемая в кэш и в файлы матриц признаков
+const uint64_t FEATURES_CONFIG = uint64_t(FEATURES_VERSION) << 48 | uint64_t(CELLS) << 32 |
+                                 uint64_t(SEGMENTS) << 16 | COLOR_CELLS << 8 | LBP_CELLS;
+
+// How features are extracted, set from the command line
+struct TExtractionParams {
+        // Number of threads
+    size_t threads;
+        // Kind of LBP histograms
+    TLbpMode lbp_mode;
+        // Dalal-Triggs HOG (see THogEngine) instead of the simple one
+    bool dalal_triggs;
+        // Grid of Dalal-Triggs HOG cells over the image, cells per side
+    uint hog_cells;
+        // Orientation bins of Dalal-Triggs HOG
+    uint hog_bins;
+        // Feature cache file, empty if cache isn't used
+    string cache_file;
+        // Feature matrix file to read instead of extraction, may be empty
+    string features_file;
+        // Feature matrix file to save features to, may be empty
+    string save_features_file;
+
+    TExtractionParams(): threads(1), lbp_mode(LBP_ALL), dalal_triggs(false), hog_cells(8),
+        hog_bins(9), cache_file(), features_file(), save_features_file() {}
+};
+
+// длина HOG части дескриптора
+size_t hog_size(const TExtractionParams & params)
+{
+    if (!params.dalal_triggs) {
+        return HOG_SIZE;
+    }
+    return THogEngine(params.hog_bins).DescriptorSize(params.hog_cells, params.hog_cells);
+}
+
+// длина дескриптора: HOG, средние цвета клеток, гистограммы LBP
+size_t descriptor_size(const TExtractionParams & params)
+{
+    return hog_size(params) + COLOR_SIZE + LBP_CELLS * LBP_CELLS * TLbpTable(params.lbp_mode).size;
+}
+
+// конфигурация с учетом параметров; для всех 256 кодов LBP и прежнего HOG она прежняя
+// вариант LBP в битах 56-59, HOG Далала-Триггса - бит 60, число клеток в битах 40-47
+// и сегментов в битах 24-31 (эти биты в FEATURES_CONFIG свободны)
+uint64_t features_config(const TExtractionParams & params)
+{
+    uint64_t config = FEATURES_CONFIG | uint64_t(params.lbp_mode) << 56;
+    if (params.dalal_triggs) {
+        config |= uint64_t(1) << 60 | uint64_t(params.hog_cells & 0xff) << 40 |
+                  uint64_t(params.hog_bins & 0xff) << 24;
+    }
+    return config;
+}
+
 // Load list of files and its labels from 'data_file' and
 // stores it in 'file_list'
 void LoadFileList(const string& data_file, TFileList* file_list) {
@@ -58,18 +170,6 @@ void LoadFileList(const string& data_file, TFileList* file_list) {
     stream.close();
 }
 
-// Load images by list of files 'file_list' and store them in 'data_set'
-void LoadImages(const TFileList& file_list, TDataSet* data_set) {
-    for (size_t img_idx = 0; img_idx < file_list.size(); ++img_idx) {
-            // Create image
-        BMP* image = new BMP();
-            // Read image from file
-        image->ReadFromFile(file_list[img_idx].first.c_str());
-            // Add image and it's label to dataset
-        data_set->push_back(make_pair(image, file_list[img_idx].second));
-    }
-}
-
 // Save result of prediction to file
 void SavePredictions(const TFileList& file_list,
                      const TLabels& labels, 
@@ -85,363 +185,564 @@ void SavePredictions(const TFileList& file_list,
     stream.close();
 }
 
+// Рабочие буферы одного потока: живут от изображения к изображению,
+// память под них выделяется заново, только если меняется размер
+struct TFeatureScratch {
+    FImage gray; // яркость с рамкой в 1 пиксель, строки выровнены (MatrixLayout::Aligned)
+    vector<float> hog_magnitude; // модули градиента одной строки
+    vector<int> hog_segment; // сегменты направлений градиента одной строки
+    vector<unsigned char> lbp_codes; // коды локальных бинарных шаблонов одной строки
+    std::unique_ptr<THogEngine> dalal_triggs; // HOG Далала-Триггса, создается при первом вызове
+};
+
 // Преобразование изображения в оттенки серого и изображения в формат MImage заодно
-FImage grayscale(BMP & image) 
+// результат сразу с рамкой в 1 пиксель, рамка повторяет крайние пиксели, как extra_borders(1, 1)
+void grayscale(BMP & image, FImage * result)
 {
-    FImage result(image.TellHeight(), image.TellWidth());
+    uint rows = image.TellHeight(), cols = image.TellWidth();
+    if (result->n_rows != rows + 2 || result->n_cols != cols + 2) {
+        *result = FImage(rows + 2, cols + 2, MatrixLayout::Aligned);
+    }
 
     // Y = 0.299R + 0.587G + 0.114B - яркость пикселя изображения
-    for (uint i = 0; i < result.n_rows; i++) {
-        for (uint j = 0; j < result.n_cols; j++) {
-            RGBApixel *pixel = image(j, i);
+    for (uint i = 0; i < rows; i++) {
+        const RGBApixel *row = image.Row(i); // пиксели строки лежат подряд
+        float *out = result->row(i + 1);
+        for (uint j = 0; j < cols; j++) {
+            const RGBApixel *pixel = row + j;
             float gs_pix = 0.299 * pixel->Red + 0.587 * pixel->Green + 0.114 * pixel->Blue; // яркость пикселя
 
-            result(i, j) = gs_pix; // как бы выставляем все каналы одинаковыми
+            out[j + 1] = gs_pix; // как бы выставляем все каналы одинаковыми
         }
+        out[0] = out[1]; // левый и правый края
+        out[cols + 1] = out[cols];
     }
-
-    return result;
+    // верхний и нижний края вместе с углами
+    std::copy(result->row(1), result->row(1) + cols + 2, result->row(0));
+    std::copy(result->row(rows), result->row(rows) + cols + 2, result->row(rows + 1));
 }
 
-// горизонтальный фильтр Собеля
-FImage sobel_x(const FImage & image)
-{
-    FImage result(image.n_rows, image.n_cols); // по краям остаются нули, но теперь это легко обрезать
-
-    for (uint i = 1; i < image.n_rows - 1; i++) {
-    	for (uint j = 1; j < image.n_cols - 1; j++) {
-            float pixel_left = image(i, j - 1);
-            float pixel = image(i, j);
-            float pixel_right = image(i, j + 1);
+static_assert(SEGMENTS % 2 == 0, "0 and pi must be segment boundaries");
 
-            result(i, j) = (-1) * pixel_left + 0 * pixel + 1 * pixel_right;
-	}
-    }
+// сегмент направления градиента через atan2, по определению
+// atan2 считаем в double, а храним во float, как и раньше,
+// чтобы углы на границах сегментов не поменялись
+int segment_atan2(float vx, float vy)
+{
+    double ang_seg = 2 * M_PI / SEGMENTS; // доля угла в сегменте
+    float v_dest = std::atan2(double(vy), double(vx)); // направление вектора градиента
 
-    return result.submatrix(1, 1, result.n_rows - 2, result.n_cols - 2); // обрезали
+    int place_ang = (v_dest + M_PI) / ang_seg; // сегмент, в который попадает угол
+    if (place_ang >= SEGMENTS) { place_ang = SEGMENTS - 1; } // на случай 2 * M_PI
+    return place_ang;
 }
 
-// вертикальный фильтр Собеля
-// переполнения быть не должно
-FImage sobel_y(const FImage & image)
-{
-    FImage result(image.n_rows, image.n_cols); // по краям остаются нули, но теперь это легко обрезать
+// вектор ближе к границе сегмента, чем SEGMENT_MARGIN * (|vx| + |vy|),
+// считается через atan2: погрешность округлений в обоих способах гораздо меньше
+const float SEGMENT_MARGIN = 1e-5f;
+
+// Сегменты направлений без atan2. Сегмент k - углы [-pi + k * 2pi / SEGMENTS, ...).
+// Вектор из нижней полуплоскости поворачиваем на pi (сегмент уменьшится на SEGMENTS / 2),
+// а в верхней полуплоскости сегмент - число границ, которые вектор обогнал против часовой
+// стрелки; это знак векторного произведения границы и вектора
+struct TSegmentBounds {
+    float cos[SEGMENTS / 2 - 1]; // границы в верхней полуплоскости, кроме 0 и pi
+    float sin[SEGMENTS / 2 - 1];
+    // сегменты нулевого вектора и векторов вдоль осей: они лежат на границах;
+    // у atan2 знак нуля важен, индекс - знаки vx и vy (1 - минус)
+    int zero[2][2], right, up, left[2], down;
+
+    TSegmentBounds()
+    {
+        double ang_seg = 2 * M_PI / SEGMENTS;
+        for (uint k = 0; k < SEGMENTS / 2 - 1; k++) {
+            cos[k] = std::cos((k + 1) * ang_seg);
+            sin[k] = std::sin((k + 1) * ang_seg);
+        }
+        // atan2 вектора вдоль оси не зависит от его длины
+        for (uint x_sign = 0; x_sign < 2; x_sign++) {
+            for (uint y_sign = 0; y_sign < 2; y_sign++) {
+                zero[x_sign][y_sign] = segment_atan2(x_sign ? -0.0f : 0.0f, y_sign ? -0.0f : 0.0f);
+            }
+        }
+        left[0] = segment_atan2(-1, 0.0f);
+        left[1] = segment_atan2(-1, -0.0f);
+        right = segment_atan2(1, 0);
+        up = segment_atan2(0, 1);
+        down = segment_atan2(0, -1);
+    }
 
-    for (uint i = 1; i < image.n_rows - 1; i++) {
-    	for (uint j = 1; j < image.n_cols - 1; j++) {
-            float pixel_up = image(i - 1, j);
-            float pixel = image(i, j);
-            float pixel_down = image(i + 1, j);
+    // сегмент по границам или -1, если вектор слишком близко к границе
+    int approximate(float vx, float vy) const
+    {
+        int lower = vy < 0;
+        float sx = lower ? -vx : vx, sy = lower ? -vy : vy; // теперь угол в [0, pi]
+        float margin = SEGMENT_MARGIN * (std::fabs(sx) + sy);
+        int segment = lower ? 0 : SEGMENTS / 2;
+        int near = !(sy > margin); // близко к границам 0 и pi
+        for (uint k = 0; k < SEGMENTS / 2 - 1; k++) {
+            float cross = cos[k] * sy - sin[k] * sx;
+            segment += cross > 0;
+            near |= std::fabs(cross) <= margin;
+        }
+        return near ? -1 : segment;
+    }
 
-            result(i, j) = 1 * pixel_up + 0 * pixel + (-1) * pixel_down; 
-	}
+    // сегмент вектора у границы: векторы вдоль осей по таблице, остальные через atan2
+    int exact(float vx, float vy) const
+    {
+        bool x_zero = std::fpclassify(vx) == FP_ZERO, y_zero = std::fpclassify(vy) == FP_ZERO;
+        if (x_zero && y_zero) { return zero[std::signbit(vx)][std::signbit(vy)]; }
+        if (y_zero) { return vx > 0 ? right : left[std::signbit(vy)]; }
+        if (x_zero) { return vy > 0 ? up : down; }
+        return segment_atan2(vx, vy);
     }
 
-    return result.submatrix(1, 1, result.n_rows - 2, result. n_cols - 2); // обрезали
-}
+    // модули и сегменты градиентов (или -1, как в approximate) строки картинки с рамкой
+    // по строкам над ней (prev), ней самой (cur) и под ней (next); на SSE2 по 4 пикселя за раз с той же
+    // арифметикой: сравнения дают маски, а не ветвления. Строка cur выровнена на 16 байт
+    // (MatrixLayout::Aligned), левые соседи cur + j читаются выровненной загрузкой
+    void row(const float * prev, const float * cur, const float * next, uint cols,
+             float * v_abs, int * segment) const
+    {
+        uint j = 0;
+#ifdef __SSE2__
+        const __m128 sign = _mm_set1_ps(-0.0f), zeros = _mm_setzero_ps();
+        const __m128 margin_scale = _mm_set1_ps(SEGMENT_MARGIN);
+        for (; j + 4 <= cols; j += 4) {
+            __m128 vx = _mm_sub_ps(_mm_loadu_ps(cur + j + 2), _mm_load_ps(cur + j));
+            __m128 vy = _mm_sub_ps(_mm_loadu_ps(prev + j + 1), _mm_loadu_ps(next + j + 1));
+            _mm_storeu_ps(v_abs + j, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy))));
+
+            __m128 lower = _mm_cmplt_ps(vy, zeros);
+            __m128 flip = _mm_and_ps(lower, sign); // смена знака в нижней полуплоскости
+            __m128 sx = _mm_xor_ps(vx, flip), sy = _mm_xor_ps(vy, flip);
+            __m128 margin = _mm_mul_ps(margin_scale, _mm_add_ps(_mm_andnot_ps(sign, sx), sy));
+            __m128i seg = _mm_andnot_si128(_mm_castps_si128(lower), _mm_set1_epi32(SEGMENTS / 2));
+            __m128 near = _mm_cmpngt_ps(sy, margin);
+            for (uint k = 0; k < SEGMENTS / 2 - 1; k++) {
+                __m128 cross = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(cos[k]), sy),
+                                          _mm_mul_ps(_mm_set1_ps(sin[k]), sx));
+                // маска сравнения - это -1 в каждом пикселе, где оно верно
+                seg = _mm_sub_epi32(seg, _mm_castps_si128(_mm_cmpgt_ps(cross, zeros)));
+                near = _mm_or_ps(near, _mm_cmple_ps(_mm_andnot_ps(sign, cross), margin));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(segment + j),
+                             _mm_or_si128(seg, _mm_castps_si128(near)));
+        }
+#endif
+        for (; j < cols; j++) {
+            float vx = cur[j + 2] - cur[j]; // правый сосед минус левый
+            float vy = prev[j + 1] - next[j + 1]; // верхний сосед минус нижний
+            v_abs[j] = std::sqrt(vx * vx + vy * vy);
+            segment[j] = approximate(vx, vy);
+        }
+    }
+};
 
-FImage grad_abs(const FImage & x, const FImage & y)
+// модули и сегменты градиентов строки i картинки gray с рамкой, сегменты точно как у atan2;
+// строки gray должны быть выровнены (MatrixLayout::Aligned), иначе исключение
+void hog_row(const FImage & gray, uint i, float * v_abs, int * segment)
 {
-    FImage result(x.n_rows, x.n_cols); 
+    static const TSegmentBounds bounds;
+    if (gray.layout() != MatrixLayout::Aligned) {
+        throw string("Rows of gray image for HOG must be aligned");
+    }
 
-    for (uint i = 0; i < x.n_rows; i++) {
-        for (uint j = 0; j < x.n_cols; j++) {
-            result(i, j) = sqrt(x(i, j) * x(i, j) + y(i, j) * y(i, j));
+    uint cols = gray.n_cols - 2;
+    const float *up = gray.row(i), *mid = gray.row(i + 1), *down = gray.row(i + 2);
+    bounds.row(up, mid, down, cols, v_abs, segment);
+    // редкие векторы у границ сегментов
+    for (uint j = 0; j < cols; j++) {
+        if (segment[j] < 0) {
+            segment[j] = bounds.exact(mid[j + 2] - mid[j], up[j + 1] - down[j + 1]);
         }
     }
-
-    return result;
 }
 
-// число пи - M_PI
-FImage grad_dest(const FImage & x, const FImage & y)
+// HOG за один проход по яркости с рамкой: для каждой строки тут же считаются
+// производные (как фильтры Собеля без весов), модуль и сегмент направления градиента,
+// и они сразу копятся в гистограмму клетки, без изображений модулей и углов
+// гистограммы клеток (по строкам клеток, SEGMENTS чисел на клетку) пишутся в hog
+// и нормируются; сегменты совпадают с atan2, арифметика та же, что и при раздельных проходах
+void hog_features(const FImage & gray, float * hog, TFeatureScratch * scratch)
 {
-    FImage result(x.n_rows, x.n_cols);
-
-    for (uint i = 0; i < x.n_rows; i++) {
-        for (uint j = 0; j < x.n_cols; j++) {
-            result(i, j) = atan2(y(i, j), x(i, j)); // atan2 вроде контролирует нули  
+    uint rows = gray.n_rows - 2, cols = gray.n_cols - 2; // размер без рамки
+    std::fill(hog, hog + HOG_SIZE, 0.0f);
+    float norms[CELLS * CELLS] = {}; // квадраты норм клеток
+
+    vector<float> & v_abs = scratch->hog_magnitude; // модули вектора градиента
+    vector<int> & segment = scratch->hog_segment; // сегменты, в которые попадают углы
+    v_abs.resize(cols);
+    segment.resize(cols);
+
+    uint cell_h = rows / CELLS, cell_w = cols / CELLS; // ширина и высота одной клетки в пикселях
+    for (uint i = 0; i < rows; i++) {
+        hog_row(gray, i, v_abs.data(), segment.data());
+
+        uint place_i = i / cell_h; // из какой пиксель клетки
+        if (place_i >= CELLS) { place_i = CELLS - 1; } // боковые пиксели относятся к последней клетке
+
+        // строку проходим по клеткам, последняя клетка забирает остаток
+        for (uint place_j = 0; place_j < CELLS; place_j++) {
+            float *histo = hog + (place_i * CELLS + place_j) * SEGMENTS;
+            float &norm = norms[place_i * CELLS + place_j];
+            uint end = place_j == CELLS - 1 ? cols : (place_j + 1) * cell_w;
+            for (uint j = place_j * cell_w; j < end; j++) {
+                histo[segment[j]] += v_abs[j];
+                norm += v_abs[j] * v_abs[j]; // копим норму
+            }
         }
     }
 
-    return result;
+    for (uint cell = 0; cell < CELLS * CELLS; cell++) {
+        float norm = sqrt(norms[cell]); // евклидова норма клетки
+        if (norm > 0) {
+            for (uint k = 0; k < SEGMENTS; k++) { // и сразу нормируем гистограммы
+                hog[cell * SEGMENTS + k] /= norm;
+            }
+        }
+    }
 }
 
-vector<float> color_features(BMP & image)
+// средние цвета клеток, по три числа (красный, зеленый, синий) на клетку, клетки по строкам;
+// суммы копятся прямо в result (COLOR_SIZE чисел) и там же делятся
+void color_features(BMP & image, float * result)
 {
-    vector<float> result; // вектор цветов
-
-    FImage red(COLOR_CELLS, COLOR_CELLS), 
-           green(COLOR_CELLS, COLOR_CELLS), 
-           blue(COLOR_CELLS, COLOR_CELLS); // матрицы для средних цветов каждой клетки
-
-    // обнуляем эти матрицы
-    for (uint i = 0; i < red.n_rows; i++) {
-        for (uint j = 0; j < red.n_cols; j++) {
-            red(i, j) = green(i, j) = blue(i, j) = 0;
-        }
-    }
+    std::fill(result, result + COLOR_SIZE, 0.0f);
 
     int cell_h = image.TellHeight() / COLOR_CELLS, cell_w = image.TellWidth() / COLOR_CELLS; // ширина и высота одной клетки в пикселях
     for (int i = 0; i < image.TellHeight(); i++) {
+        const RGBApixel *row = image.Row(i);
         for (int j = 0; j < image.TellWidth(); j++) {
             // нужно определить в какую именно клетку по вертикали и горизонтали попадает пиксель
             uint place_i = i / cell_h, place_j = j / cell_w; // из какой пиксель клетки
             if (place_i >= COLOR_CELLS) { place_i = COLOR_CELLS - 1; } // боковые пиксели относятся к последней клетке
             if (place_j >= COLOR_CELLS) { place_j = COLOR_CELLS - 1; }
 
-            RGBApixel *pixel = image(j, i); // вытаскиваем пиксель
+            const RGBApixel *pixel = row + j; // вытаскиваем пиксель
+            float *cell = result + (place_i * COLOR_CELLS + place_j) * 3;
 
-            red(place_i, place_j) += pixel->Red; 
-            green(place_i, place_j) += pixel->Green;
-            blue(place_i, place_j) += pixel->Blue;
+            cell[0] += pixel->Red;
+            cell[1] += pixel->Green;
+            cell[2] += pixel->Blue;
         }
     }
 
     // считаем средний цвет для каждой клетки как среднее арифметическое
-    for (uint i = 0; i < red.n_rows; i++) {
-        for (uint j = 0; j < red.n_cols; j++) {
+    for (uint i = 0; i < COLOR_CELLS; i++) {
+        for (uint j = 0; j < COLOR_CELLS; j++) {
             int num_pix; // число пикселей в клетке
             
-            if (i == red.n_rows - 1) { // по краю снизу клетка может быть больше обычного
+            if (i == COLOR_CELLS - 1) { // по краю снизу клетка может быть больше обычного
                 num_pix = cell_h + image.TellHeight() % COLOR_CELLS; 
             } else {
                 num_pix = cell_h;
             }
 
-            if (j == red.n_cols - 1) { // по краю справа клетка может быть больше обычного
+            if (j == COLOR_CELLS - 1) { // по краю справа клетка может быть больше обычного
                 num_pix *= cell_w + image.TellWidth() % COLOR_CELLS; 
             } else {
                 num_pix *= cell_w;
             }
 
-            red(i, j) /= num_pix;
-            green(i, j) /= num_pix;
-            blue(i, j) /= num_pix;
-
-            // сразу нормируем и заносим в результирующий вектор
-            result.push_back(red(i, j) / 255);
-            result.push_back(green(i, j) / 255);
-            result.push_back(blue(i, j) / 255);
+            float *cell = result + (i * COLOR_CELLS + j) * 3;
+            for (uint c = 0; c < 3; c++) {
+                cell[c] /= num_pix;
+                cell[c] /= 255; // сразу нормируем
+            }
         }
     }
-
-    return result;
 }
 
-vector<float> local_binary_patterns(const FImage & image)
+// коды локальных бинарных шаблонов одной строки картинки с рамкой по строкам
+// над ней (prev), ней самой (cur) и под ней (next): бит соседа равен 1, если центр
+// не ярче соседа; соседи по строкам сверху вниз, в строке слева направо.
+// На SSE2 соседи 16 пикселей - это сдвинутые загрузки строк, сравнение дает маску
+// на каждый пиксель, маски складываются в коды и упаковываются в 16 байт
+void lbp_row_codes(const float * prev, const float * cur, const float * next, uint cols,
+                   unsigned char * codes)
 {
-    vector<float> result;
-
-    FImage bins(image.n_rows - 2, image.n_cols - 2);
-    for (uint i = 1; i < image.n_rows - 1; i++) {
-        for (uint j = 1; j < image.n_cols - 1; j++) {
-            // смотрим на соседей каждого пикселя
-            uint nei = 0; // какой по счёту сосед
-            uint bin_code = 0; // бинарный код для (i, j)-го пикселя
-
-            for (uint nei_i = i - 1; nei_i <= i + 1; nei_i++) {
-                for (uint nei_j = j - 1; nei_j <= j + 1; nei_j++) {
-
-                    if ((nei_i != i) || (nei_j != j)) { // если это не сам пиксель
-                        if (image(i, j) <= image(nei_i, nei_j)) { bin_code = bin_code | (1 << nei); } 
-                        
-                        nei++; // следующий сосед; всего их 8
-                    }
-                    
-                }
+    uint j = 0;
+#ifdef __SSE2__
+    // строки и сдвиги соседей относительно левого верхнего угла окрестности, по номерам битов
+    const float * const rows[8] = {prev, prev, prev, cur, cur, next, next, next};
+    const uint shifts[8] = {0, 1, 2, 0, 2, 0, 1, 2};
+    for (; j + 16 <= cols; j += 16) {
+        __m128i quarters[4]; // коды по 4 пикселя в 32-битных числах
+        for (uint q = 0; q < 4; q++) {
+            uint col = j + 4 * q;
+            __m128 center = _mm_loadu_ps(cur + col + 1);
+            __m128i code = _mm_setzero_si128();
+            for (uint bit = 0; bit < 8; bit++) {
+                __m128 mask = _mm_cmple_ps(center, _mm_loadu_ps(rows[bit] + col + shifts[bit]));
+                code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(mask), _mm_set1_epi32(1 << bit)));
             }
-           
-            bins(i - 1, j - 1) = bin_code; // теперь каждый пиксель имеет свой бинарный код, который число 0..255
+            quarters[q] = code;
         }
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(quarters[0], quarters[1]),
+                                          _mm_packs_epi32(quarters[2], quarters[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(codes + j), packed);
     }
-
-    HistoMatrix histo(LBP_CELLS, LBP_CELLS); // гистограммы каждой клетки
-    for (uint i = 0; i < LBP_CELLS; i++) {
-        for (uint j = 0; j < LBP_CELLS; j++) {
-            for (uint k = 0; k < 256; k++) { // обнуляем каждую гистограмму
-                histo(i, j).push_back(0);
-            }
-        }
+#endif
+    for (; j < cols; j++) {
+        float center = cur[j + 1];
+        codes[j] = (center <= prev[j]) | (center <= prev[j + 1]) << 1 | (center <= prev[j + 2]) << 2 |
+                   (center <= cur[j]) << 3 | (center <= cur[j + 2]) << 4 |
+                   (center <= next[j]) << 5 | (center <= next[j + 1]) << 6 |
+                   (center <= next[j + 2]) << 7;
     }
+}
+
+// гистограммы LBP клеток со столбцами по таблице lbp, по lbp.size чисел на клетку,
+// клетки по строкам; копятся и нормируются прямо в result
+void local_binary_patterns(const FImage & image, const TLbpTable & lbp, float * result,
+                           TFeatureScratch * scratch)
+{
+    std::fill(result, result + LBP_CELLS * LBP_CELLS * lbp.size, 0.0f);
+
+    uint rows = image.n_rows - 2, cols = image.n_cols - 2; // размер без рамки
+    vector<unsigned char> & codes = scratch->lbp_codes; // коды одной строки, числа 0..255
+    codes.resize(cols);
 
-    uint cell_h = bins.n_rows / LBP_CELLS, cell_w = bins.n_cols / LBP_CELLS; // ширина и высота одной клетки в пикселях
+    uint cell_h = rows / LBP_CELLS, cell_w = cols / LBP_CELLS; // ширина и высота одной клетки в пикселях
     // если cell_h или cell_w получается меньше остатка от деления на LBP_CELLS, то клетки снизу и справа сильно больше остальных
     // ну и ничего страшного, исправления получаются недокостылями
-    for (uint i = 0; i < bins.n_rows; i++) {
-        for (uint j = 0; j < bins.n_cols; j++) {
-            // нужно определить в какую именно клетку по вертикали и горизонтали попадает пиксель
-            // а потом найти для него место в гистограмме
-            uint place_i = i / cell_h, place_j = j / cell_w; // из какой пиксель клетки
-            if (place_i >= LBP_CELLS) { place_i = LBP_CELLS - 1; } // боковые пиксели относятся к последней клетке
-            if (place_j >= LBP_CELLS) { place_j = LBP_CELLS - 1; }  
-
-            histo(place_i, place_j)[bins(i, j)]++; // формируем гистограмму
+    for (uint i = 0; i < rows; i++) {
+        lbp_row_codes(image.row(i), image.row(i + 1), image.row(i + 2), cols, codes.data());
+
+        uint place_i = i / cell_h; // из какой пиксель клетки
+        if (place_i >= LBP_CELLS) { place_i = LBP_CELLS - 1; } // боковые пиксели относятся к последней клетке
+
+        // коды строки сразу идут в гистограммы, последняя клетка забирает остаток
+        for (uint place_j = 0; place_j < LBP_CELLS; place_j++) {
+            float *histo = result + (place_i * LBP_CELLS + place_j) * lbp.size;
+            uint end = place_j == LBP_CELLS - 1 ? cols : (place_j + 1) * cell_w;
+            for (uint j = place_j * cell_w; j < end; j++) {
+                histo[lbp.bins[codes[j]]]++; // формируем гистограмму
+            }
         }
     }
 
-    FImage norms(LBP_CELLS, LBP_CELLS); // тут считаем евклидову норму каждой гистограммы
-    for (uint i = 0; i < LBP_CELLS; i++) {
-        for (uint j = 0; j < LBP_CELLS; j++) {
-
-            norms(i, j) = 0;
-            for (uint k = 0; k < 256; k++) {
-                norms(i, j) += histo(i, j)[k] * histo(i, j)[k];
-            }
-            norms(i, j) = sqrt(norms(i, j));
+    for (uint cell = 0; cell < LBP_CELLS * LBP_CELLS; cell++) {
+        float *histo = result + cell * lbp.size;
+        float norm = 0; // евклидова норма гистограммы
+        for (uint k = 0; k < lbp.size; k++) {
+            norm += histo[k] * histo[k];
+        }
+        norm = sqrt(norm);
 
-            if (norms(i, j) > 0) {
-                for (uint k = 0; k < 256; k++) {
-                    histo(i, j)[k] /= norms(i, j); // нормализуем гистограммы
-                }
+        if (norm > 0) {
+            for (uint k = 0; k < lbp.size; k++) {
+                histo[k] /= norm; // нормализуем гистограммы
             }
-            
-            result.insert(result.end(), histo(i, j).begin(), histo(i, j).end()); // конкатенируем все гистограммы
         }
     }
-
-    return result;
 }
 
-// Exatract features from dataset.
-// You should implement this function by yourself =)
-void ExtractFeatures(const TDataSet& data_set, TFeatures* features) {
-    for (size_t image_idx = 0; image_idx < data_set.size(); ++image_idx) {
-        // PLACE YOUR CODE HERE
-        // Remove this sample code and place your feature extraction code here
-
-        BMP image = *(data_set[image_idx].first); // изображение, которое мучаем
-
-        // цветовые признаки
-        vector<float> color = color_features(image);
-        // конец цветовых признаков
-
-        // HOG
-        FImage gs_image = grayscale(image); // преобразуем в оттенки серого
-        
-        gs_image = gs_image.extra_borders(1, 1); // дополняем границы
-
-        // локальные бинарные шаблоны
-        vector<float> locbinpat = local_binary_patterns(gs_image);
-        // конец локальных бинарных шаблонов
-
-        FImage image_vx = sobel_x(gs_image); // горизонтальная составляющая вектора градиента
-        FImage image_vy = sobel_y(gs_image); // вертикальная составляющая вектора градиента
-
-        FImage v_abs = grad_abs(image_vx, image_vy); // модуль вектора градиента
-        FImage v_dest = grad_dest(image_vx, image_vy); // направление вектора градиента
-	
-        // ненормированное заполнение гистограмм
-        FImage norms(CELLS, CELLS); // матрица из норм клеток
-        HistoMatrix histo(CELLS, CELLS); // гистограммы каждой клетки
-
-        for (uint i = 0; i < CELLS; i++) {
-            for (uint j = 0; j < CELLS; j++) {
-                norms(i, j) = 0; // обнуляем матрицу норм
-
-                for (uint k = 0; k < SEGMENTS; k++) { // обнуляем каждую гистограмму
-                    histo(i, j).push_back(0);
-                }
-            }
+// Extract features of one image into 'desc' of descriptor_size() floats
+// with LBP histograms by 'lbp', using buffers of the calling thread.
+// Every part is accumulated right in its place in 'desc', nothing is copied.
+void ImageFeatures(BMP& image, const TExtractionParams& params, const TLbpTable& lbp,
+                   float* desc, TFeatureScratch* scratch) {
+    FImage & gs_image = scratch->gray;
+    grayscale(image, &gs_image); // преобразуем в оттенки серого, сразу с дополненными границами
+
+    // гистограммы градиентов
+    if (params.dalal_triggs) {
+        if (!scratch->dalal_triggs) {
+            scratch->dalal_triggs.reset(new THogEngine(params.hog_bins));
         }
+        // сетка hog_cells x hog_cells на все изображение, клетки могут быть дробными
+        uint cells = params.hog_cells;
+        scratch->dalal_triggs->ComputeCells(gs_image, float(image.TellHeight()) / cells,
+                                            float(image.TellWidth()) / cells, cells, cells);
+        scratch->dalal_triggs->Describe(0, 0, cells, cells, desc);
+    } else {
+        hog_features(gs_image, desc, scratch);
+    }
+    desc += hog_size(params);
 
-        uint cell_h = v_abs.n_rows / CELLS, cell_w = v_abs.n_cols / CELLS; // ширина и высота одной клетки в пикселях
-        double ang_seg = 2 * M_PI / SEGMENTS; // доля угла в сегменте
-        for (uint i = 0; i < v_abs.n_rows; i++) {
-            for (uint j = 0; j < v_abs.n_cols; j++) {
-                // нужно определить в какую именно клетку по вертикали и горизонтали попадает пиксель
-                // а потом найти для него место в гистограмме
-                uint place_i = i / cell_h, place_j = j / cell_w; // из какой пиксель клетки
-                if (place_i >= CELLS) { place_i = CELLS - 1; } // боковые пиксели относятся к последней клетке
-                if (place_j >= CELLS) { place_j = CELLS - 1; }
-
-                int place_ang = (v_dest(i, j) + M_PI) / ang_seg; // сегмент, в который попадает угол
-                if (place_ang >= SEGMENTS) { place_ang = SEGMENTS - 1; } // на случай 2 * M_PI
-
-                histo(place_i, place_j)[place_ang] += v_abs(i, j);
-                norms(place_i, place_j) += v_abs(i, j) * v_abs(i, j); // копим норму
-            }
-        }
-
-        for (uint i = 0; i < CELLS; i++) {
-            for (uint j = 0; j < CELLS; j++) {
-                norms(i, j) = sqrt(norms(i, j)); // евклидова норма клетки
-
-                for (uint k = 0; k < SEGMENTS; k++) { // и сразу нормируем гистограммы
-                    if (norms(i, j) > 0) {
-                        histo(i, j)[k] /= norms(i, j);
-                    }
-                }
-            }
-        }
+    color_features(image, desc); // цветовые признаки
+    local_binary_patterns(gs_image, lbp, desc + COLOR_SIZE, scratch); // локальные бинарные шаблоны
+}
 
-        // формируем дескриптор
-        vector<float> desc;
-        for (uint i = 0; i < CELLS; i++) {
-            for (uint j = 0; j < CELLS; j++) {
-                desc.insert(desc.end(), histo(i, j).begin(), histo(i, j).end());
+// Extract features from images of 'file_list' on 'params.threads' threads.
+// Every thread decodes an image, extracts its features and frees it
+// (see TImageLoader), so only a few images are in memory at once.
+// Descriptors go straight into rows of 'features' allocated beforehand,
+// so their order doesn't depend on the order of processing.
+// If there is a cache file, descriptors of unchanged images are taken
+// from it, and only the rest are extracted and added to the cache.
+void ExtractFeatures(const TFileList& file_list, const TExtractionParams& params,
+                     TFeatures* features) {
+    const TLbpTable lbp(params.lbp_mode);
+    size_t dim = descriptor_size(params);
+    features->Resize(file_list.size(), dim);
+    for (size_t idx = 0; idx < file_list.size(); ++idx)
+        features->Label(idx) = file_list[idx].second;
+
+    std::unique_ptr<TFeatureCache> cache;
+        // Images which aren't in the cache and their rows in 'features'
+    TFileList missing;
+    vector<size_t> missing_rows;
+    if (!params.cache_file.empty()) {
+        cache.reset(new TFeatureCache(params.cache_file, dim, features_config(params)));
+        for (size_t idx = 0; idx < file_list.size(); ++idx) {
+            if (!cache->Lookup(file_list[idx].first, features->Row(idx))) {
+                missing.push_back(file_list[idx]);
+                missing_rows.push_back(idx);
             }
         }
-        desc.insert(desc.end(), color.begin(), color.end()); // цветовые признаки
-        desc.insert(desc.end(), locbinpat.begin(), locbinpat.end()); // локальные бинарные шаблоны
-
-        (*features).push_back(make_pair(desc, data_set[image_idx].second));
-
-        // End of sample code
+    } else {
+        missing = file_list;
+        for (size_t idx = 0; idx < file_list.size(); ++idx)
+            missing_rows.push_back(idx);
     }
+    if (missing.empty())
+        return;
+
+    TImageLoader loader(missing, params.threads);
+    vector<TFeatureScratch> scratch(loader.Threads());
+    loader.ForEach([&](TLoadedImage& loaded, size_t worker) {
+        float* desc = features->Row(missing_rows[loaded.index]);
+        ImageFeatures(*loaded.image, params, lbp, desc, &scratch[worker]);
+        if (cache)
+            cache->Store(missing[loaded.index].first, desc);
+    });
+    if (cache)
+        cache->Save();
 }
 
-// Clear dataset structure
-void ClearDataset(TDataSet* data_set) {
-        // Delete all images from dataset
-    for (size_t image_idx = 0; image_idx < data_set->size(); ++image_idx)
-        delete (*data_set)[image_idx].first;
-        // Clear dataset
-    data_set->clear();
+// Features of images of 'file_list': mapped from the feature matrix file
+// if there is one, otherwise extracted. Saved to a feature matrix file
+// if requested. Throws std::string on errors with feature matrix files.
+void GetFeatures(const TFileList& file_list, const TExtractionParams& params,
+                 TFeatures* features) {
+    if (!params.features_file.empty()) {
+        TFeatureFileInfo info;
+        *features = MapFeatures(params.features_file, &info);
+        if (info.config != features_config(params) ||
+            features->Dim() != descriptor_size(params))
+            throw string("Features in ") + params.features_file + " were extracted differently";
+        if (features->Samples() != file_list.size())
+            throw string("Features in ") + params.features_file + " don't match the dataset";
+    } else {
+        ExtractFeatures(file_list, params, features);
+    }
+    if (!params.save_features_file.empty())
+        SaveFeatures(*features, features_config(params), params.save_features_file);
 }
 
-// Train SVM classifier using data from 'data_file' and save trained model
-// to 'model_file'
-void TrainClassifier(const string& data_file, const string& model_file) {
-        // List of image file names and its labels
-    TFileList file_list;
-        // Structure of images and its labels
-    TDataSet data_set;
-        // Structure of features of images and its labels
-    TFeatures features;
+// C of the classifier unless it is chosen by cross validation
+static const double DEFAULT_C = 0.01;
+
+// Train SVM classifier with parameter 'C' on 'features' and save trained
+// model to 'model_file'
+void TrainModel(const TFeatures& features, double C, size_t threads,
+                const string& model_file) {
         // Model which would be trained
     TModel model;
         // Parameters of classifier
     TClassifierParams params;
-    
-        // Load list of image file names and its labels
-    LoadFileList(data_file, &file_list);
-        // Load images
-    LoadImages(file_list, &data_set);
-        // Extract features from images
-    ExtractFeatures(data_set, &features);
 
         // PLACE YOUR CODE HERE
         // You can change parameters of classifier here
-    params.C = 0.01;
+    params.C = C;
+        // One-vs-rest classes are trained on the same threads as extraction
+    params.nr_thread = threads;
     TClassifier classifier(params);
         // Train classifier
     classifier.Train(features, &model);
         // Save model to file
     model.Save(model_file);
-        // Clear dataset structure
-    ClearDataset(&data_set);
+}
+
+// Train SVM classifier using data from 'data_file' and save trained model
+// to 'model_file'
+void TrainClassifier(const string& data_file, const string& model_file,
+                     const TExtractionParams& extraction) {
+        // List of image file names and its labels
+    TFileList file_list;
+        // Structure of features of images and its labels
+    TFeatures features;
+
+        // Load list of image file names and its labels
+    LoadFileList(data_file, &file_list);
+        // Load images and extract their features
+    GetFeatures(file_list, extraction, &features);
+
+    TrainModel(features, DEFAULT_C, extraction.threads, model_file);
+}
+
+// K-fold cross validation on data from 'data_file' for every C of 'grid'.
+// Features are extracted once for all folds and values of C; values are
+// tried in ascending order, each starting from the solutions of the
+// previous one. Accuracy and wall time of every C are printed, and if
+// 'model_file' isn't empty, the model with the best C (the smallest of
+// equal ones) is trained on the whole dataset and saved there.
+// Throws std::string if there are fewer samples than folds.
+void CrossValidateGrid(const string& data_file, const string& model_file,
+                       const TExtractionParams& extraction, int folds,
+                       vector<double> grid) {
+    TFileList file_list;
+    TFeatures features;
+    LoadFileList(data_file, &file_list);
+    GetFeatures(file_list, extraction, &features);
+    size_t samples = features.Samples();
+    if (samples < size_t(folds))
+        throw string("Dataset has fewer samples than folds");
+
+        // Samples in random order are dealt to folds in turn,
+        // folds are the same for all values of C
+    vector<size_t> order(samples);
+    for (size_t idx = 0; idx < samples; ++idx)
+        order[idx] = idx;
+    std::shuffle(order.begin(), order.end(), std::mt19937(1));
+    vector<int> fold(samples);
+    for (size_t idx = 0; idx < samples; ++idx)
+        fold[order[idx]] = idx % folds;
+
+    std::sort(grid.begin(), grid.end());
+    vector<double> dual;
+    double best_C = grid[0];
+    size_t best_correct = 0;
+    for (size_t point = 0; point < grid.size(); ++point) {
+        TClassifierParams params;
+        params.C = grid[point];
+        params.nr_thread = extraction.threads;
+        TClassifier classifier(params);
+        TLabels labels;
+
+        auto start = std::chrono::steady_clock::now();
+        classifier.CrossValidate(features, fold, folds, &dual, &labels);
+        std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+
+        size_t correct = 0;
+        for (size_t idx = 0; idx < samples; ++idx)
+            if (labels[idx] == features.Label(idx))
+                ++correct;
+        cout << "C = " << grid[point] << ": accuracy " << double(correct) / samples
+             << " (" << correct << "/" << samples << "), " << time.count() << " s" << endl;
+        if (correct > best_correct) {
+            best_correct = correct;
+            best_C = grid[point];
+        }
+    }
+    cout << "Best C = " << best_C << endl;
+
+    if (!model_file.empty())
+        TrainModel(features, best_C, extraction.threads, model_file);
 }
 
 // Predict data from 'data_file' using model from 'model_file' and
 // save predictions to 'prediction_file'
 void PredictData(const string& data_file,
                  const string& model_file,
-                 const string& prediction_file) {
+                 const string& prediction_file,
+                 const TExtractionParams& extraction) {
         // List of image file names and its labels
     TFileList file_list;
-        // Structure of images and its labels
-    TDataSet data_set;
         // Structure of features of images and its labels
     TFeatures features;
         // List of image labels
@@ -449,10 +750,8 @@ void PredictData(const string& data_file,
 
         // Load list of image file names and its labels
     LoadFileList(data_file, &file_list);
-        // Load images
-    LoadImages(file_list, &data_set);
-        // Extract features from images
-    ExtractFeatures(data_set, &features);
+        // Load images and extract their features
+    GetFeatures(file_list, extraction, &features);
 
         // Classifier 
     TClassifier classifier = TClassifier(TClassifierParams());
@@ -466,8 +765,411 @@ void PredictData(const string& data_file,
 
         // Save predictions
     SavePredictions(file_list, labels, prediction_file);
-        // Clear dataset structure
-    ClearDataset(&data_set);
+}
+
+// Parameters of sliding-window detection, set from the command line
+struct TDetectionParams {
+        // Side of the square window in pixels of a pyramid level
+    uint window;
+        // Every next level of the pyramid is this many times smaller
+    float scale_step;
+        // Windows with smaller decision value aren't reported
+    float threshold;
+        // Only windows of class 'label' are reported, unless 'any_label'
+    bool any_label;
+    int label;
+
+    TDetectionParams(): window(60), scale_step(1.2f), threshold(0), any_label(true), label(0) {}
+};
+
+// Window found in a frame, coordinates and size in pixels of the frame
+struct TDetection {
+    uint x;
+    uint y;
+    uint size;
+    int label;
+    float score;
+};
+
+float dot_product(const float * a, const float * b, uint size)
+{
+    float sum = 0;
+    for (uint k = 0; k < size; k++) {
+        sum += a[k] * b[k];
+    }
+    return sum;
+}
+
+uint lcm(uint a, uint b)
+{
+    uint x = a, y = b;
+    while (y) {
+        uint rest = x % y;
+        x = y;
+        y = rest;
+    }
+    return a / x * b;
+}
+
+// Окно делится на window_units x window_units единиц так, что каждая клетка
+// каждой части дескриптора складывается из целых единиц. Гистограммы единиц
+// считаются один раз на уровень пирамиды, а гистограммы клеток всех окон -
+// их суммы. HOG Далала-Триггса считается по своим клеткам, см. detect_level
+uint window_units(const TExtractionParams & params)
+{
+    uint hog_grid = params.dalal_triggs ? params.hog_cells : CELLS;
+    return lcm(lcm(hog_grid, COLOR_CELLS), LBP_CELLS);
+}
+
+// Признаки клеток size x size единиц во всех положениях на сетке единиц уровня:
+// channels чисел на клетку с левым верхним углом в единице (y, x), по строкам
+struct TCellMap {
+    uint rows, cols, channels;
+    vector<float> values;
+
+    TCellMap() : rows(0), cols(0), channels(0), values() {}
+
+    const float * At(uint y, uint x) const
+    {
+        return values.data() + (size_t(y) * cols + x) * channels;
+    }
+    float * At(uint y, uint x)
+    {
+        return values.data() + (size_t(y) * cols + x) * channels;
+    }
+};
+
+// суммы блоков size x size единиц из units (units_y x units_x единиц по channels чисел)
+// во всех положениях: сначала по строкам в sums, потом по столбцам в map
+void block_sums(const vector<float> & units, uint units_y, uint units_x, uint channels,
+                uint size, vector<float> * sums, TCellMap * map)
+{
+    map->rows = units_y - size + 1;
+    map->cols = units_x - size + 1;
+    map->channels = channels;
+
+    sums->assign(size_t(units_y) * map->cols * channels, 0.0f);
+    for (uint y = 0; y < units_y; y++) {
+        for (uint x = 0; x < map->cols; x++) {
+            float *out = sums->data() + (size_t(y) * map->cols + x) * channels;
+            for (uint dx = 0; dx < size; dx++) {
+                const float *unit = units.data() + (size_t(y) * units_x + x + dx) * channels;
+                for (uint c = 0; c < channels; c++) {
+                    out[c] += unit[c];
+                }
+            }
+        }
+    }
+
+    map->values.assign(size_t(map->rows) * map->cols * channels, 0.0f);
+    for (uint y = 0; y < map->rows; y++) {
+        for (uint dy = 0; dy < size; dy++) {
+            const float *row = sums->data() + size_t(y + dy) * map->cols * channels;
+            float *out = map->At(y, 0);
+            for (size_t k = 0; k < size_t(map->cols) * channels; k++) {
+                out[k] += row[k];
+            }
+        }
+    }
+}
+
+// Уровень пирамиды: кадр, уменьшенный в scale раз билинейной интерполяцией
+struct TPyramidLevel {
+    float scale;
+    FImage red, green, blue; // каналы уровня
+    FImage gray; // яркость с рамкой в 1 пиксель, как у grayscale
+};
+
+// Рабочие буферы поиска одного потока, как TFeatureScratch
+struct TDetectionScratch {
+    TPyramidLevel level;
+    vector<float> hog_magnitude; // модули градиента одной строки
+    vector<int> hog_segment; // сегменты направлений градиента одной строки
+    vector<unsigned char> lbp_codes; // коды LBP одной строки
+    vector<int> unit_col; // единица каждого столбца уровня, -1 за последней целой единицей
+    vector<float> hog_units, color_units, lbp_units; // гистограммы единиц
+    vector<float> sums; // промежуточные суммы block_sums
+    TCellMap hog, color, lbp; // нормированные признаки клеток
+    vector<float> desc; // HOG Далала-Триггса одного окна
+    std::unique_ptr<THogEngine> dalal_triggs;
+    vector<float> scores;
+};
+
+void pyramid_level(BMP & frame, float scale, TPyramidLevel * level)
+{
+    uint frame_rows = frame.TellHeight(), frame_cols = frame.TellWidth();
+    uint rows = uint(frame_rows / scale), cols = uint(frame_cols / scale);
+    level->scale = scale;
+    if (level->red.n_rows != rows || level->red.n_cols != cols) {
+        level->red = FImage(rows, cols);
+        level->green = FImage(rows, cols);
+        level->blue = FImage(rows, cols);
+        level->gray = FImage(rows + 2, cols + 2, MatrixLayout::Aligned);
+    }
+
+    // центр пикселя уровня в координатах кадра и соседи слева и справа от него
+    vector<uint> left(cols), right(cols);
+    vector<float> weight(cols); // вес правого соседа
+    for (uint j = 0; j < cols; j++) {
+        float x = std::min(std::max((j + 0.5f) * scale - 0.5f, 0.0f), float(frame_cols - 1));
+        left[j] = uint(x);
+        right[j] = std::min(left[j] + 1, frame_cols - 1);
+        weight[j] = x - left[j];
+    }
+
+    for (uint i = 0; i < rows; i++) {
+        float y = std::min(std::max((i + 0.5f) * scale - 0.5f, 0.0f), float(frame_rows - 1));
+        uint top = uint(y), bottom = std::min(top + 1, frame_rows - 1);
+        float down = y - top; // вес нижнего соседа
+        const RGBApixel *upper = frame.Row(top), *lower = frame.Row(bottom);
+        float *red = level->red.row(i), *green = level->green.row(i), *blue = level->blue.row(i);
+        for (uint j = 0; j < cols; j++) {
+            const RGBApixel &a = upper[left[j]], &b = upper[right[j]];
+            const RGBApixel &c = lower[left[j]], &d = lower[right[j]];
+            float w = weight[j];
+            red[j] = (1 - down) * ((1 - w) * a.Red + w * b.Red) + down * ((1 - w) * c.Red + w * d.Red);
+            green[j] = (1 - down) * ((1 - w) * a.Green + w * b.Green) +
+                       down * ((1 - w) * c.Green + w * d.Green);
+            blue[j] = (1 - down) * ((1 - w) * a.Blue + w * b.Blue) + down * ((1 - w) * c.Blue + w * d.Blue);
+        }
+    }
+
+    // яркость внутри рамки одним проходом по трем каналам, в double, как в grayscale
+    FImage & gray = level->gray;
+    FImage inner = gray.submatrix(1, 1, rows, cols);
+    evaluate(0.299 * level->red + 0.587 * level->green + 0.114 * level->blue, &inner);
+    for (uint i = 1; i <= rows; i++) {
+        gray.row(i)[0] = gray.row(i)[1];
+        gray.row(i)[cols + 1] = gray.row(i)[cols];
+    }
+    std::copy(gray.row(1), gray.row(1) + cols + 2, gray.row(0));
+    std::copy(gray.row(rows), gray.row(rows) + cols + 2, gray.row(rows + 1));
+}
+
+// Все окна одного уровня с шагом в одну единицу (для HOG Далала-Триггса - в одну его клетку).
+// Пиксели копятся в гистограммы единиц, из них - признаки клеток во всех положениях,
+// и решающая функция окна - сумма скалярных произведений признаков его клеток с весами
+// этих клеток в модели: дескриптор окна целиком не собирается. Признаки окна равны
+// признакам ImageFeatures вырезанного окна с точностью до пикселей на границах клеток
+// (клетки тут ровно по единицам) и градиентов на краю окна (тут соседи - пиксели уровня)
+void detect_level(const TDetectionParams & detection, const TExtractionParams & params,
+                  const TLbpTable & lbp, const TDenseModel & filter,
+                  TDetectionScratch * scratch, vector<TDetection> * found)
+{
+    const TPyramidLevel & level = scratch->level;
+    uint rows = level.red.n_rows, cols = level.red.n_cols;
+    uint units = window_units(params);
+    float unit = float(detection.window) / units; // сторона единицы в пикселях уровня
+    uint units_y = uint(rows / unit), units_x = uint(cols / unit);
+    if (units_y < units || units_x < units) {
+        return;
+    }
+
+    vector<int> & unit_col = scratch->unit_col;
+    unit_col.resize(cols);
+    for (uint j = 0; j < cols; j++) {
+        uint unit_x = uint(j / unit);
+        unit_col[j] = unit_x < units_x ? int(unit_x) : -1;
+    }
+
+    // гистограммы единиц: HOG с суммой квадратов модулей для нормы, суммы цветов с числом пикселей, LBP
+    const uint hog_channels = SEGMENTS + 1, color_channels = 4;
+    bool simple_hog = !params.dalal_triggs;
+    size_t unit_count = size_t(units_y) * units_x;
+    scratch->hog_units.assign(simple_hog ? unit_count * hog_channels : 0, 0.0f);
+    scratch->color_units.assign(unit_count * color_channels, 0.0f);
+    scratch->lbp_units.assign(unit_count * lbp.size, 0.0f);
+    scratch->hog_magnitude.resize(cols);
+    scratch->hog_segment.resize(cols);
+    scratch->lbp_codes.resize(cols);
+    const float *v_abs = scratch->hog_magnitude.data();
+    const int *segment = scratch->hog_segment.data();
+    const unsigned char *codes = scratch->lbp_codes.data();
+
+    for (uint i = 0; i < rows; i++) {
+        uint unit_y = uint(i / unit);
+        if (unit_y >= units_y) {
+            break;
+        }
+        if (simple_hog) {
+            hog_row(level.gray, i, scratch->hog_magnitude.data(), scratch->hog_segment.data());
+        }
+        lbp_row_codes(level.gray.row(i), level.gray.row(i + 1), level.gray.row(i + 2), cols,
+                      scratch->lbp_codes.data());
+
+        const float *red = level.red.row(i), *green = level.green.row(i), *blue = level.blue.row(i);
+        for (uint j = 0; j < cols && unit_col[j] >= 0; j++) {
+            size_t place = size_t(unit_y) * units_x + unit_col[j];
+            if (simple_hog) {
+                float *histo = scratch->hog_units.data() + place * hog_channels;
+                histo[segment[j]] += v_abs[j];
+                histo[SEGMENTS] += v_abs[j] * v_abs[j];
+            }
+            float *color = scratch->color_units.data() + place * color_channels;
+            color[0] += red[j];
+            color[1] += green[j];
+            color[2] += blue[j];
+            color[3] += 1;
+            scratch->lbp_units[place * lbp.size + lbp.bins[codes[j]]]++;
+        }
+    }
+
+    // признаки клеток во всех положениях, нормированные как в hog_features,
+    // color_features и local_binary_patterns
+    if (simple_hog) {
+        block_sums(scratch->hog_units, units_y, units_x, hog_channels, units / CELLS,
+                   &scratch->sums, &scratch->hog);
+        for (size_t cell = 0; cell < scratch->hog.values.size(); cell += hog_channels) {
+            float *histo = scratch->hog.values.data() + cell;
+            float norm = sqrt(histo[SEGMENTS]);
+            if (norm > 0) {
+                for (uint k = 0; k < SEGMENTS; k++) {
+                    histo[k] /= norm;
+                }
+            }
+        }
+    }
+    block_sums(scratch->color_units, units_y, units_x, color_channels, units / COLOR_CELLS,
+               &scratch->sums, &scratch->color);
+    for (size_t cell = 0; cell < scratch->color.values.size(); cell += color_channels) {
+        float *color = scratch->color.values.data() + cell;
+        if (!(color[3] > 0)) { // в клетке нет пикселей, суммы нулевые
+            continue;
+        }
+        for (uint c = 0; c < 3; c++) {
+            color[c] /= color[3];
+            color[c] /= 255;
+        }
+    }
+    block_sums(scratch->lbp_units, units_y, units_x, lbp.size, units / LBP_CELLS,
+               &scratch->sums, &scratch->lbp);
+    for (size_t cell = 0; cell < scratch->lbp.values.size(); cell += lbp.size) {
+        float *histo = scratch->lbp.values.data() + cell;
+        float norm = sqrt(dot_product(histo, histo, lbp.size));
+        if (norm > 0) {
+            for (uint k = 0; k < lbp.size; k++) {
+                histo[k] /= norm;
+            }
+        }
+    }
+
+    // HOG Далала-Триггса: клетки по step единиц на весь уровень, окна с шагом в клетку
+    uint step = 1;
+    if (!simple_hog) {
+        if (!scratch->dalal_triggs) {
+            scratch->dalal_triggs.reset(new THogEngine(params.hog_bins));
+        }
+        step = units / params.hog_cells;
+        scratch->dalal_triggs->ComputeCells(level.gray, unit * step, unit * step,
+                                            units_y / step, units_x / step);
+        scratch->desc.resize(hog_size(params));
+    }
+
+    const uint hog_k = units / CELLS, color_k = units / COLOR_CELLS, lbp_k = units / LBP_CELLS;
+    const size_t hog_length = hog_size(params);
+    vector<float> & scores = scratch->scores;
+    scores.resize(filter.Functions());
+    for (uint y = 0; y + units <= units_y; y += step) {
+        for (uint x = 0; x + units <= units_x; x += step) {
+            if (!simple_hog) {
+                scratch->dalal_triggs->Describe(y / step, x / step, params.hog_cells, params.hog_cells,
+                                                scratch->desc.data());
+            }
+            for (uint k = 0; k < filter.Functions(); k++) {
+                const float *w = filter.Weights(k);
+                float &score = scores[k];
+                score = filter.Bias(k);
+                if (simple_hog) {
+                    for (uint ci = 0; ci < CELLS; ci++) {
+                        for (uint cj = 0; cj < CELLS; cj++) {
+                            score += dot_product(scratch->hog.At(y + ci * hog_k, x + cj * hog_k),
+                                                 w + (ci * CELLS + cj) * SEGMENTS, SEGMENTS);
+                        }
+                    }
+                } else {
+                    score += dot_product(scratch->desc.data(), w, hog_length);
+                }
+                w += hog_length;
+                for (uint ci = 0; ci < COLOR_CELLS; ci++) {
+                    for (uint cj = 0; cj < COLOR_CELLS; cj++) {
+                        score += dot_product(scratch->color.At(y + ci * color_k, x + cj * color_k),
+                                             w + (ci * COLOR_CELLS + cj) * 3, 3);
+                    }
+                }
+                w += COLOR_SIZE;
+                for (uint ci = 0; ci < LBP_CELLS; ci++) {
+                    for (uint cj = 0; cj < LBP_CELLS; cj++) {
+                        score += dot_product(scratch->lbp.At(y + ci * lbp_k, x + cj * lbp_k),
+                                             w + (ci * LBP_CELLS + cj) * lbp.size, lbp.size);
+                    }
+                }
+            }
+
+            // метка и значение ее решающей функции, как в predict
+            TDetection window;
+            window.label = filter.Label(scores.data(), &window.score);
+            if (window.score < detection.threshold ||
+                (!detection.any_label && window.label != detection.label)) {
+                continue;
+            }
+            float to_frame = unit * level.scale; // единица в пикселях кадра
+            window.x = uint(x * to_frame + 0.5f);
+            window.y = uint(y * to_frame + 0.5f);
+            window.size = uint(detection.window * level.scale + 0.5f);
+            found->push_back(window);
+        }
+    }
+}
+
+// все окна всех уровней пирамиды кадра: уровни уменьшаются в scale_step раз,
+// пока в них помещается окно
+void detect_frame(BMP & frame, const TDetectionParams & detection, const TExtractionParams & params,
+                  const TLbpTable & lbp, const TDenseModel & filter,
+                  TDetectionScratch * scratch, vector<TDetection> * found)
+{
+    for (float scale = 1; frame.TellHeight() / scale >= detection.window &&
+                          frame.TellWidth() / scale >= detection.window; scale *= detection.scale_step) {
+        pyramid_level(frame, scale, &scratch->level);
+        detect_level(detection, params, lbp, filter, scratch, found);
+    }
+}
+
+// Find objects in frames listed in 'data_file' (labels there are ignored)
+// with sliding windows over image pyramids, scoring windows with the model
+// from 'model_file'. Found windows are saved to 'detection_file', one per
+// line: frame file, x, y and size of the window in frame pixels, label and
+// decision value. Frames are processed on 'extraction.threads' threads.
+void DetectObjects(const string& data_file, const string& model_file,
+                   const string& detection_file, const TExtractionParams& extraction,
+                   const TDetectionParams& detection) {
+    TFileList file_list;
+    LoadFileList(data_file, &file_list);
+
+    TModel model;
+    model.Load(model_file);
+    if (!model.get())
+        throw string("Error reading model file ") + model_file;
+        // Model weights are used as linear filters over cell features
+    const TDenseModel filter(model.get());
+    if (filter.Dim() != descriptor_size(extraction))
+        throw string("Model was trained on other features");
+    const TLbpTable lbp(extraction.lbp_mode);
+
+        // Windows of every frame, in the order of the list
+    vector<vector<TDetection> > found(file_list.size());
+    TImageLoader loader(file_list, extraction.threads);
+    vector<TDetectionScratch> scratch(loader.Threads());
+    loader.ForEach([&](TLoadedImage& loaded, size_t worker) {
+        detect_frame(*loaded.image, detection, extraction, lbp, filter, &scratch[worker],
+                     &found[loaded.index]);
+    });
+
+    ofstream stream(detection_file.c_str());
+    for (size_t frame_idx = 0; frame_idx < file_list.size(); ++frame_idx)
+        for (const TDetection& window : found[frame_idx])
+            stream << file_list[frame_idx].first << " " << window.x << " " << window.y << " "
+                   << window.size << " " << window.label << " " << window.score << endl;
+    stream.close();
 }
 
 int main(int argc, char** argv) {
@@ -486,6 +1188,38 @@ int main(int argc, char** argv) {
         ArgvParser::OptionRequiresValue);
     cmd.defineOption("train", "Train classifier");
     cmd.defineOption("predict", "Predict dataset");
+    cmd.defineOption("threads", "Number of threads for feature extraction, "
+        "by default one per hardware thread", ArgvParser::OptionRequiresValue);
+    cmd.defineOption("lbp", "LBP histograms: all (256 bins, default), uniform (59) "
+        "or riu (rotation invariant uniform, 10)", ArgvParser::OptionRequiresValue);
+    cmd.defineOption("hog", "HOG descriptor: simple (default) or dalal_triggs "
+        "(2x2 blocks with L2-Hys, interpolated votes)", ArgvParser::OptionRequiresValue);
+    cmd.defineOption("hog_cells", "Cells per image side for dalal_triggs HOG, 8 by default",
+        ArgvParser::OptionRequiresValue);
+    cmd.defineOption("hog_bins", "Orientation bins for dalal_triggs HOG, 9 by default",
+        ArgvParser::OptionRequiresValue);
+    cmd.defineOption("features", "Feature matrix file saved by --save_features "
+        "to use instead of extraction", ArgvParser::OptionRequiresValue);
+    cmd.defineOption("save_features", "File to save feature matrix to",
+        ArgvParser::OptionRequiresValue);
+    cmd.defineOption("feature_cache", "File to keep image features between runs, "
+        "created if missing", ArgvParser::OptionRequiresValue);
+    cmd.defineOption("detect", "Find objects in frames of dataset with sliding windows "
+        "over image pyramids");
+    cmd.defineOption("detections", "Path to file to save found windows to",
+        ArgvParser::OptionRequiresValue);
+    cmd.defineOption("window", "Side of detection window in pixels, 60 by default",
+        ArgvParser::OptionRequiresValue);
+    cmd.defineOption("scale_step", "Scale between pyramid levels, 1.2 by default",
+        ArgvParser::OptionRequiresValue);
+    cmd.defineOption("threshold", "Smallest decision value of reported windows, 0 by default",
+        ArgvParser::OptionRequiresValue);
+    cmd.defineOption("detect_label", "Report only windows of this class",
+        ArgvParser::OptionRequiresValue);
+    cmd.defineOption("cv", "Cross-validate with this many folds for every C of --grid; "
+        "with --train the best C is used", ArgvParser::OptionRequiresValue);
+    cmd.defineOption("grid", "Values of C for --cv: C=<value>,<value>,..., "
+        "0.01 by default", ArgvParser::OptionRequiresValue);
         
         // Add options aliases
     cmd.defineOptionAlternative("data_set", "d");
@@ -493,6 +1227,7 @@ int main(int argc, char** argv) {
     cmd.defineOptionAlternative("predicted_labels", "l");
     cmd.defineOptionAlternative("train", "t");
     cmd.defineOptionAlternative("predict", "p");
+    cmd.defineOptionAlternative("feature_cache", "c");
 
         // Parse options
     int result = cmd.parse(argc, argv);
@@ -508,20 +1243,151 @@ int main(int argc, char** argv) {
     string model_file = cmd.optionValue("model");
     bool train = cmd.foundOption("train");
     bool predict = cmd.foundOption("predict");
+    TExtractionParams extraction;
+    extraction.threads = TWorkStealingPool::DefaultThreads();
+    if (cmd.foundOption("threads")) {
+        int value = atoi(cmd.optionValue("threads").c_str());
+        if (value <= 0) {
+            cerr << "Error! Option --threads must be a positive number!" << endl;
+            return 1;
+        }
+        extraction.threads = value;
+    }
+    if (cmd.foundOption("lbp")) {
+        string mode = cmd.optionValue("lbp");
+        if (mode == "all") {
+            extraction.lbp_mode = LBP_ALL;
+        } else if (mode == "uniform") {
+            extraction.lbp_mode = LBP_UNIFORM;
+        } else if (mode == "riu") {
+            extraction.lbp_mode = LBP_ROTATION_INVARIANT;
+        } else {
+            cerr << "Error! Option --lbp must be all, uniform or riu!" << endl;
+            return 1;
+        }
+    }
+    if (cmd.foundOption("hog")) {
+        string mode = cmd.optionValue("hog");
+        if (mode == "dalal_triggs") {
+            extraction.dalal_triggs = true;
+        } else if (mode != "simple") {
+            cerr << "Error! Option --hog must be simple or dalal_triggs!" << endl;
+            return 1;
+        }
+    }
+    if (cmd.foundOption("hog_cells")) {
+        int value = atoi(cmd.optionValue("hog_cells").c_str());
+        if (value < 2 || value > 255) {
+            cerr << "Error! Option --hog_cells must be a number from 2 to 255!" << endl;
+            return 1;
+        }
+        extraction.hog_cells = value;
+    }
+    if (cmd.foundOption("hog_bins")) {
+        int value = atoi(cmd.optionValue("hog_bins").c_str());
+        if (value < 2 || value > 255) {
+            cerr << "Error! Option --hog_bins must be a number from 2 to 255!" << endl;
+            return 1;
+        }
+        extraction.hog_bins = value;
+    }
+    if (cmd.foundOption("feature_cache"))
+        extraction.cache_file = cmd.optionValue("feature_cache");
+    if (cmd.foundOption("features"))
+        extraction.features_file = cmd.optionValue("features");
+    if (cmd.foundOption("save_features"))
+        extraction.save_features_file = cmd.optionValue("save_features");
+    bool detect = cmd.foundOption("detect");
+    TDetectionParams detection;
+    if (cmd.foundOption("window")) {
+        int value = atoi(cmd.optionValue("window").c_str());
+        if (value < 8) {
+            cerr << "Error! Option --window must be a number not less than 8!" << endl;
+            return 1;
+        }
+        detection.window = value;
+    }
+        // every unit of the window must have at least one pixel
+    if (detect && detection.window < window_units(extraction)) {
+        cerr << "Error! Option --window must be not less than "
+             << window_units(extraction) << " for these features!" << endl;
+        return 1;
+    }
+    if (cmd.foundOption("scale_step")) {
+        detection.scale_step = atof(cmd.optionValue("scale_step").c_str());
+        if (!(detection.scale_step > 1)) {
+            cerr << "Error! Option --scale_step must be greater than 1!" << endl;
+            return 1;
+        }
+    }
+    if (cmd.foundOption("threshold"))
+        detection.threshold = atof(cmd.optionValue("threshold").c_str());
+    if (cmd.foundOption("detect_label")) {
+        detection.any_label = false;
+        detection.label = atoi(cmd.optionValue("detect_label").c_str());
+    }
 
-        // If we need to train classifier
-    if (train)
-        TrainClassifier(data_file, model_file);
-        // If we need to predict data
-    if (predict) {
-            // You must declare file to save images
-        if (!cmd.foundOption("predicted_labels")) {
-            cerr << "Error! Option --predicted_labels not found!" << endl;
+    int folds = 0;
+    if (cmd.foundOption("cv")) {
+        folds = atoi(cmd.optionValue("cv").c_str());
+        if (folds < 2) {
+            cerr << "Error! Option --cv must be a number not less than 2!" << endl;
+            return 1;
+        }
+    }
+    vector<double> grid(1, DEFAULT_C);
+    if (cmd.foundOption("grid")) {
+        string values = cmd.optionValue("grid");
+        bool valid = values.compare(0, 2, "C=") == 0;
+        grid.clear();
+        for (size_t begin = 2; valid && begin <= values.size(); ) {
+            size_t end = std::min(values.find(',', begin), values.size());
+            char* parsed_end;
+            string value = values.substr(begin, end - begin);
+            grid.push_back(strtod(value.c_str(), &parsed_end));
+            valid = !value.empty() && *parsed_end == '\0' && grid.back() > 0;
+            begin = end + 1;
+        }
+        if (!valid) {
+            cerr << "Error! Option --grid must be C=<value>,<value>,... "
+                 << "with positive values!" << endl;
             return 1;
         }
-            // File to save predictions
-        string prediction_file = cmd.optionValue("predicted_labels");
-            // Predict data
-        PredictData(data_file, model_file, prediction_file);
+        if (!folds) {
+            cerr << "Error! Option --grid needs --cv!" << endl;
+            return 1;
+        }
+    }
+
+    try {
+            // Choose C by cross validation, then train with it if needed
+        if (folds)
+            CrossValidateGrid(data_file, train ? model_file : string(), extraction, folds, grid);
+            // If we need to train classifier
+        else if (train)
+            TrainClassifier(data_file, model_file, extraction);
+            // If we need to predict data
+        if (predict) {
+                // You must declare file to save images
+            if (!cmd.foundOption("predicted_labels")) {
+                cerr << "Error! Option --predicted_labels not found!" << endl;
+                return 1;
+            }
+                // File to save predictions
+            string prediction_file = cmd.optionValue("predicted_labels");
+                // Predict data
+            PredictData(data_file, model_file, prediction_file, extraction);
+        }
+        if (detect) {
+            if (!cmd.foundOption("detections")) {
+                cerr << "Error! Option --detections not found!" << endl;
+                return 1;
+            }
+            DetectObjects(data_file, model_file, cmd.optionValue("detections"), extraction,
+                          detection);
+        }
+    } catch (const string& error) {
+        cerr << "Error! " << error << endl;
+        return 1;
     }
 }
@@ -0,0 +1,109 @@
+#include "thread_pool.h"
+
+#include <exception>
+#include <thread>
+
+using std::lock_guard;
+using std::mutex;
+
+TWorkStealingPool::TWorkStealingPool(size_t threads):
+    threads_(threads ? threads : 1),
+    ranges_(threads_),
+    failed_(false),
+    failure_mutex_()
+{}
+
+size_t TWorkStealingPool::DefaultThreads() {
+    size_t threads = std::thread::hardware_concurrency();
+    return threads ? threads : 1;
+}
+
+void TWorkStealingPool::Run(size_t tasks,
+                            const std::function<void(size_t task, size_t worker)>& body) {
+        // Equal contiguous ranges to start with
+    for (size_t worker = 0; worker < threads_; ++worker) {
+        ranges_[worker].begin = tasks * worker / threads_;
+        ranges_[worker].end = tasks * (worker + 1) / threads_;
+    }
+    failed_ = false;
+
+    std::vector<std::thread> workers;
+    std::vector<std::exception_ptr> errors(threads_);
+    auto guarded = [this, &body, &errors](size_t worker) {
+        try {
+            Work(worker, body);
+        } catch (...) {
+            errors[worker] = std::current_exception();
+            lock_guard<mutex> lock(failure_mutex_);
+            failed_ = true;
+        }
+    };
+
+    for (size_t worker = 1; worker < threads_; ++worker)
+        workers.push_back(std::thread(guarded, worker));
+    guarded(0);
+    for (size_t idx = 0; idx < workers.size(); ++idx)
+        workers[idx].join();
+
+    for (size_t worker = 0; worker < threads_; ++worker)
+        if (errors[worker])
+            std::rethrow_exception(errors[worker]);
+}
+
+void TWorkStealingPool::Work(size_t worker, const std::function<void(size_t, size_t)>& body) {
+    size_t task;
+    while (Take(worker, &task)) {
+        {
+            lock_guard<mutex> lock(failure_mutex_);
+            if (failed_)
+                return;
+        }
+        body(task, worker);
+    }
+}
+
+bool TWorkStealingPool::Take(size_t worker, size_t* task) {
+    TRange& own = ranges_[worker];
+    {
+        lock_guard<mutex> lock(own.mutex);
+        if (own.begin < own.end) {
+            *task = own.begin++;
+            return true;
+        }
+    }
+
+    for (;;) {
+            // Victim is the worker with the most tasks left
+        size_t victim = threads_, most = 0;
+        for (size_t other = 0; other < threads_; ++other) {
+            if (other == worker)
+                continue;
+            lock_guard<mutex> lock(ranges_[other].mutex);
+            size_t left = ranges_[other].end - ranges_[other].begin;
+            if (left > most) {
+                most = left;
+                victim = other;
+            }
+        }
+        if (victim == threads_)
+            return false;
+
+        size_t begin, end;
+        {
+            lock_guard<mutex> lock(ranges_[victim].mutex);
+            TRange& range = ranges_[victim];
+            if (range.begin == range.end)
+                continue; // taken meanwhile, look again
+                // Back half, or the only task
+            begin = range.begin + (range.end - range.begin) / 2;
+            end = range.end;
+            range.end = begin;
+        }
+
+        lock_guard<mutex> lock(own.mutex);
+        own.begin = begin + 1;
+        own.end = end;
+        *task = begin;
+        return true;
+    }
+}